@@ -0,0 +1,86 @@
+/* getAjaxRouteMenu.action */
+var routeMenu = [
+  { text: "1", url: "/schedules/getSchedule.action?runboardId=153&routeId=1", group: "Local" },
+  { text: "3", url: "/schedules/getSchedule.action?runboardId=153&routeId=3", group: "Local" },
+  { text: "4", url: "/schedules/getSchedule.action?runboardId=153&routeId=4", group: "Local" },
+  { text: "6", url: "/schedules/getSchedule.action?runboardId=153&routeId=6", group: "Local" },
+  { text: "7", url: "/schedules/getSchedule.action?runboardId=153&routeId=7", group: "Local" },
+  { text: "9", url: "/schedules/getSchedule.action?runboardId=153&routeId=9", group: "Local" },
+  { text: "10", url: "/schedules/getSchedule.action?runboardId=153&routeId=10", group: "Local" },
+  { text: "11", url: "/schedules/getSchedule.action?runboardId=153&routeId=11", group: "Local" },
+  { text: "14", url: "/schedules/getSchedule.action?runboardId=153&routeId=14", group: "Local" },
+  { text: "15", url: "/schedules/getSchedule.action?runboardId=153&routeId=15", group: "Local" },
+  { text: "16", url: "/schedules/getSchedule.action?runboardId=153&routeId=16", group: "Local" },
+  { text: "17", url: "/schedules/getSchedule.action?runboardId=153&routeId=17", group: "Local" },
+  { text: "19", url: "/schedules/getSchedule.action?runboardId=153&routeId=19", group: "Local" },
+  { text: "20", url: "/schedules/getSchedule.action?runboardId=153&routeId=20", group: "Local" },
+  { text: "21", url: "/schedules/getSchedule.action?runboardId=153&routeId=21", group: "Local" },
+  { text: "25", url: "/schedules/getSchedule.action?runboardId=153&routeId=25", group: "Local" },
+  { text: "26", url: "/schedules/getSchedule.action?runboardId=153&routeId=26", group: "Local" },
+  { text: "27", url: "/schedules/getSchedule.action?runboardId=153&routeId=27", group: "Local" },
+  { text: "29", url: "/schedules/getSchedule.action?runboardId=153&routeId=29", group: "Local" },
+  { text: "30", url: "/schedules/getSchedule.action?runboardId=153&routeId=30", group: "Local" },
+  { text: "31", url: "/schedules/getSchedule.action?runboardId=153&routeId=31", group: "Local" },
+  { text: "35", url: "/schedules/getSchedule.action?runboardId=153&routeId=35", group: "Local" },
+  { text: "36", url: "/schedules/getSchedule.action?runboardId=153&routeId=36", group: "Local" },
+  { text: "37", url: "/schedules/getSchedule.action?runboardId=153&routeId=37", group: "Local" },
+  { text: "38", url: "/schedules/getSchedule.action?runboardId=153&routeId=38", group: "Local" },
+  { text: "40", url: "/schedules/getSchedule.action?runboardId=153&routeId=40", group: "Local" },
+  { text: "41", url: "/schedules/getSchedule.action?runboardId=153&routeId=41", group: "Local" },
+  { text: "44", url: "/schedules/getSchedule.action?runboardId=153&routeId=44", group: "Local" },
+  { text: "45", url: "/schedules/getSchedule.action?runboardId=153&routeId=45", group: "Local" },
+  { text: "46", url: "/schedules/getSchedule.action?runboardId=153&routeId=46", group: "Local" },
+  { text: "49", url: "/schedules/getSchedule.action?runboardId=153&routeId=49", group: "Local" },
+  { text: "50", url: "/schedules/getSchedule.action?runboardId=153&routeId=50", group: "Local" },
+  { text: "51", url: "/schedules/getSchedule.action?runboardId=153&routeId=51", group: "Local" },
+  { text: "52", url: "/schedules/getSchedule.action?runboardId=153&routeId=52", group: "Local" },
+  { text: "53", url: "/schedules/getSchedule.action?runboardId=153&routeId=53", group: "Local" },
+  { text: "56", url: "/schedules/getSchedule.action?runboardId=153&routeId=56", group: "Local" },
+  { text: "57", url: "/schedules/getSchedule.action?runboardId=153&routeId=57", group: "Local" },
+  { text: "58", url: "/schedules/getSchedule.action?runboardId=153&routeId=58", group: "Local" },
+  { text: "59", url: "/schedules/getSchedule.action?runboardId=153&routeId=59", group: "Local" },
+  { text: "62", url: "/schedules/getSchedule.action?runboardId=153&routeId=62", group: "Local" },
+  { text: "64", url: "/schedules/getSchedule.action?runboardId=153&routeId=64", group: "Local" },
+  { text: "65", url: "/schedules/getSchedule.action?runboardId=153&routeId=65", group: "Local" },
+  { text: "68", url: "/schedules/getSchedule.action?runboardId=153&routeId=68", group: "Local" },
+  { text: "69", url: "/schedules/getSchedule.action?runboardId=153&routeId=69", group: "Local" },
+  { text: "70", url: "/schedules/getSchedule.action?runboardId=153&routeId=70", group: "Local" },
+  { text: "77", url: "/schedules/getSchedule.action?runboardId=153&routeId=77", group: "Local" },
+  { text: "78", url: "/schedules/getSchedule.action?runboardId=153&routeId=78", group: "Local" },
+  { text: "79", url: "/schedules/getSchedule.action?runboardId=153&routeId=79", group: "Local" },
+  { text: "80", url: "/schedules/getSchedule.action?runboardId=153&routeId=80", group: "Local" },
+  { text: "81", url: "/schedules/getSchedule.action?runboardId=153&routeId=81", group: "Local" },
+  { text: "83", url: "/schedules/getSchedule.action?runboardId=153&routeId=83", group: "Local" },
+  { text: "84", url: "/schedules/getSchedule.action?runboardId=153&routeId=84", group: "Local" },
+  { text: "87", url: "/schedules/getSchedule.action?runboardId=153&routeId=87", group: "Local" },
+  { text: "88", url: "/schedules/getSchedule.action?runboardId=153&routeId=88", group: "Local" },
+  { text: "91", url: "/schedules/getSchedule.action?runboardId=153&routeId=91", group: "Local" },
+  { text: "92", url: "/schedules/getSchedule.action?runboardId=153&routeId=92", group: "Local" },
+  { text: "94", url: "/schedules/getSchedule.action?runboardId=153&routeId=94", group: "Local" },
+  { text: "95", url: "/schedules/getSchedule.action?runboardId=153&routeId=95", group: "Local" },
+  { text: "97", url: "/schedules/getSchedule.action?runboardId=153&routeId=97", group: "Local" },
+  { text: "98", url: "/schedules/getSchedule.action?runboardId=153&routeId=98", group: "Local" },
+  { text: "99", url: "/schedules/getSchedule.action?runboardId=153&routeId=99", group: "Local" },
+  { text: "AB", url: "/schedules/getSchedule.action?runboardId=153&routeId=AB", group: "Regional" },
+  { text: "AF", url: "/schedules/getSchedule.action?runboardId=153&routeId=AF", group: "Regional" },
+  { text: "AS", url: "/schedules/getSchedule.action?runboardId=153&routeId=AS", group: "Regional" },
+  { text: "AT", url: "/schedules/getSchedule.action?runboardId=153&routeId=AT", group: "Regional" },
+  { text: "B", url: "/schedules/getSchedule.action?runboardId=153&routeId=B", group: "Regional" },
+  { text: "BF", url: "/schedules/getSchedule.action?runboardId=153&routeId=BF", group: "Regional" },
+  { text: "BX", url: "/schedules/getSchedule.action?runboardId=153&routeId=BX", group: "Regional" },
+  { text: "BOLT", url: "/schedules/getSchedule.action?runboardId=153&routeId=BOLT", group: "Regional" },
+  { text: "DASH", url: "/schedules/getSchedule.action?runboardId=153&routeId=DASH", group: "Regional" },
+  { text: "GS", url: "/schedules/getSchedule.action?runboardId=153&routeId=GS", group: "Regional" },
+  { text: "HOP", url: "/schedules/getSchedule.action?runboardId=153&routeId=HOP", group: "Regional" },
+  { text: "JUMP", url: "/schedules/getSchedule.action?runboardId=153&routeId=JUMP", group: "Regional" },
+  { text: "LD", url: "/schedules/getSchedule.action?runboardId=153&routeId=LD", group: "Regional" },
+  { text: "LX", url: "/schedules/getSchedule.action?runboardId=153&routeId=LX", group: "Regional" },
+  { text: "SKIP", url: "/schedules/getSchedule.action?runboardId=153&routeId=SKIP", group: "Regional" },
+  { text: "STAMPEDE", url: "/schedules/getSchedule.action?runboardId=153&routeId=STAMPEDE", group: "Regional" },
+  { text: "C", url: "/schedules/getSchedule.action?runboardId=153&routeId=C", group: "Regional" },
+  { text: "D", url: "/schedules/getSchedule.action?runboardId=153&routeId=D", group: "Regional" },
+  { text: "E", url: "/schedules/getSchedule.action?runboardId=153&routeId=E", group: "Regional" },
+  { text: "F", url: "/schedules/getSchedule.action?runboardId=153&routeId=F", group: "Regional" },
+  { text: "H", url: "/schedules/getSchedule.action?runboardId=153&routeId=H", group: "Regional" },
+  { text: "W", url: "/schedules/getSchedule.action?runboardId=153&routeId=W", group: "Regional" },
+];
@@ -0,0 +1,401 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+// Offline benchmarks of the engine's hot paths, run against the recorded RTD
+// pages in corpus/. Besides QTestLib's time per iteration, each benchmark
+// reports its throughput and how many heap allocations one run of it makes.
+
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QTime>
+#include <QtTest/QtTest>
+
+#include <qtest_kde.h>
+
+#include "../rtddepartures.h"
+#include "../rtdinterntable.h"
+#include "../rtdroutelist.h"
+#include "../rtdscheduleparser.h"
+#include "../rtdtimetablestore.h"
+#include "rtdbenchmarkutil.h"
+
+enum {
+    STORE_ROUTES = 150,         // about the size of RTD's network
+    STREAMED_CHUNK = 4096,      // a typical read off the network
+    NEXT_STOPS_N = 4
+};
+
+static QByteArray corpusFile(const QString& name)
+{
+    QFile file(QLatin1String(RTD_CORPUS_DIR) + name);
+    if (!file.open(QIODevice::ReadOnly))
+	qFatal("can't read %s", qPrintable(file.fileName()));
+    return file.readAll();
+}
+
+class RtdBenchmark : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+	void initTestCase();
+	void cleanupTestCase();
+
+	void parseSchedule_data();
+	void parseSchedule();
+	void parseScheduleStreamed_data();
+	void parseScheduleStreamed();
+	void parseRouteList();
+	void parseTime();
+
+	void storeWrite();
+	void storeOpen();
+	void storeLookup();
+
+	void nextStopsBuild();
+	void nextStopsTick();
+
+    private:
+	void fillStore(RtdTimetableStore *store) const;
+	StopTimetables stopTimetables(const RtdTimetableStore& store, const RtdInternTable& names) const;
+
+	QList<QByteArray> m_pages;
+	QStringList m_pageNames;
+	QStringList m_pageRoutes;
+	QList<RtdSchedule> m_schedules;
+	QStringList m_times;
+	QString m_storePath;
+};
+
+void RtdBenchmark::initTestCase()
+{
+    m_pageNames << QLatin1String("schedule-15-E-weekday.html") << QLatin1String("schedule-B-W-weekday.html")
+		<< QLatin1String("schedule-notfound.html");
+    m_pageRoutes << QLatin1String("15") << QLatin1String("B/BF/BX") << QLatin1String("15");
+    foreach (const QString& name, m_pageNames)
+	m_pages << corpusFile(name);
+
+    for (int i = 0; i < 2; i++) {
+	RtdSchedulePage page = RtdScheduleParser::parse(m_pages[i], m_pageRoutes[i]);
+	QCOMPARE(int(page.status), int(RtdSchedulePage::Found));
+	QVERIFY(!page.schedule.minutes.isEmpty());
+	m_schedules << page.schedule;
+    }
+
+    // every time cell of the corpus, as RTD writes them
+    foreach (const RtdSchedule& schedule, m_schedules) {
+	foreach (quint16 minute, schedule.minutes) {
+	    int m = minute % 1440;
+	    int hr = (m / 60) % 12;
+	    m_times << QString(QLatin1String("%1%2%3")).arg(hr ? hr : 12).arg(m % 60, 2, 10, QLatin1Char('0'))
+						   .arg(QLatin1Char(m / 60 >= 12 ? 'P' : 'A'));
+	}
+    }
+
+    m_storePath = QDir::tempPath() + QLatin1String("/rtdbenchmark-timetables.dat");
+    RtdInternTable names;
+    RtdTimetableStore store(m_storePath, &names);
+    fillStore(&store);
+    int epoch, generation;
+    QVERIFY(RtdTimetableStore::write(m_storePath, store.serialize(&epoch, &generation)));
+}
+
+void RtdBenchmark::cleanupTestCase()
+{
+    QFile::remove(m_storePath);
+}
+
+// the corpus' schedules, filed under enough routes to make a whole network
+void RtdBenchmark::fillStore(RtdTimetableStore *store) const
+{
+    store->setValidAsOf(QDate(2009, 8, 23));
+    for (int i = 0; i < STORE_ROUTES; i++) {
+	for (int day = 1; day <= 3; day++) {
+	    store->insert(QString::number(i), day, 'E', m_schedules[0]);
+	    store->insert(QString::number(i), day, 'W', m_schedules[1]);
+	}
+    }
+}
+
+void RtdBenchmark::parseSchedule_data()
+{
+    QTest::addColumn<int>("page");
+    for (int i = 0; i < m_pages.size(); i++)
+	QTest::newRow(qPrintable(m_pageNames[i])) << i;
+}
+
+void RtdBenchmark::parseSchedule()
+{
+    QFETCH(int, page);
+    const QByteArray& html = m_pages[page];
+
+    AllocationCounter allocations;
+    RtdScheduleParser::parse(html, m_pageRoutes[page]);
+    allocations.stop();
+
+    Throughput throughput(html.size(), "bytes");
+    QBENCHMARK {
+	RtdScheduleParser::parse(html, m_pageRoutes[page]);
+	throughput.run();
+    }
+    throughput.report(allocations);
+}
+
+void RtdBenchmark::parseScheduleStreamed_data()
+{
+    parseSchedule_data();
+}
+
+// the page as it comes off the network, a chunk at a time
+void RtdBenchmark::parseScheduleStreamed()
+{
+    QFETCH(int, page);
+    const QByteArray& html = m_pages[page];
+    QList<QByteArray> chunks;
+    for (int pos = 0; pos < html.size(); pos += STREAMED_CHUNK)
+	chunks << html.mid(pos, STREAMED_CHUNK);
+
+    AllocationCounter allocations;
+    {
+	RtdScheduleParser parser(m_pageRoutes[page]);
+	foreach (const QByteArray& chunk, chunks)
+	    parser.addData(chunk);
+	parser.result();
+    }
+    allocations.stop();
+
+    Throughput throughput(html.size(), "bytes");
+    QBENCHMARK {
+	RtdScheduleParser parser(m_pageRoutes[page]);
+	foreach (const QByteArray& chunk, chunks)
+	    parser.addData(chunk);
+	parser.result();
+	throughput.run();
+    }
+    throughput.report(allocations);
+}
+
+void RtdBenchmark::parseRouteList()
+{
+    QByteArray menu = corpusFile(QLatin1String("routemenu.js"));
+    QVERIFY(!parseRtdRouteList(menu).isEmpty());
+
+    AllocationCounter allocations;
+    parseRtdRouteList(menu);
+    allocations.stop();
+
+    Throughput throughput(menu.size(), "bytes");
+    QBENCHMARK {
+	parseRtdRouteList(menu);
+	throughput.run();
+    }
+    throughput.report(allocations);
+}
+
+void RtdBenchmark::parseTime()
+{
+    int sum = 0;
+    AllocationCounter allocations;
+    foreach (const QString& time, m_times)
+	sum += RtdScheduleParser::parseTime(time);
+    allocations.stop();
+    QVERIFY(sum > 0);
+
+    Throughput throughput(m_times.size(), "times");
+    QBENCHMARK {
+	foreach (const QString& time, m_times)
+	    sum += RtdScheduleParser::parseTime(time);
+	throughput.run();
+    }
+    throughput.report(allocations);
+}
+
+// filing a network's worth of parsed schedules and writing the store out
+void RtdBenchmark::storeWrite()
+{
+    QString path = m_storePath + QLatin1String(".write");
+    qint64 departures = qint64(STORE_ROUTES) * 3 * (m_schedules[0].minutes.size() + m_schedules[1].minutes.size());
+
+    AllocationCounter allocations;
+    {
+	RtdInternTable names;
+	RtdTimetableStore store(path, &names);
+	fillStore(&store);
+	int epoch, generation;
+	RtdTimetableStore::write(path, store.serialize(&epoch, &generation));
+    }
+    allocations.stop();
+
+    Throughput throughput(departures, "departures");
+    QBENCHMARK {
+	QFile::remove(path);
+	RtdInternTable names;
+	RtdTimetableStore store(path, &names);
+	fillStore(&store);
+	int epoch, generation;
+	RtdTimetableStore::write(path, store.serialize(&epoch, &generation));
+	throughput.run();
+    }
+    throughput.report(allocations);
+    QFile::remove(path);
+}
+
+// mapping the store and reading its names back into the intern table
+void RtdBenchmark::storeOpen()
+{
+    AllocationCounter allocations;
+    {
+	RtdInternTable names;
+	RtdTimetableStore store(m_storePath, &names);
+    }
+    allocations.stop();
+
+    Throughput throughput(1, "stores");
+    QBENCHMARK {
+	RtdInternTable names;
+	RtdTimetableStore store(m_storePath, &names);
+	QVERIFY(store.validAsOf().isValid());
+	throughput.run();
+    }
+    throughput.report(allocations);
+}
+
+// finding one stop of each route and day in the store, as a NextStops query does
+void RtdBenchmark::storeLookup()
+{
+    RtdInternTable names;
+    RtdTimetableStore store(m_storePath, &names);
+    quint32 station = names.find(m_schedules[0].stations.last());
+    QVERIFY(station != quint32(RtdInternTable::NoId));
+
+    QVector<quint32> routeIds;
+    for (int i = 0; i < STORE_ROUTES; i++)
+	routeIds << names.find(QString::number(i));
+
+    int found = 0;
+    AllocationCounter allocations;
+    foreach (quint32 routeId, routeIds) {
+	for (int day = 1; day <= 3; day++) {
+	    RtdTimetableStore::Route route = store.route(routeId, day, 'E');
+	    int stop = route.findStation(station);
+	    found += (stop >= 0 ? route.departureCount(stop) : 0);
+	}
+    }
+    allocations.stop();
+    QVERIFY(found > 0);
+
+    Throughput throughput(routeIds.size() * 3, "lookups");
+    QBENCHMARK {
+	foreach (quint32 routeId, routeIds) {
+	    for (int day = 1; day <= 3; day++) {
+		RtdTimetableStore::Route route = store.route(routeId, day, 'E');
+		int stop = route.findStation(station);
+		found += (stop >= 0 ? route.departureCount(stop) : 0);
+	    }
+	}
+	throughput.run();
+    }
+    throughput.report(allocations);
+}
+
+// today's and tomorrow's departures at a few stops, loaded the way the
+// engine does for a NextStops query
+StopTimetables RtdBenchmark::stopTimetables(const RtdTimetableStore& store, const RtdInternTable& names) const
+{
+    StopTimetables timetables;
+    for (int i = 0; i < NEXT_STOPS_N; i++) {
+	const RtdSchedule& schedule = m_schedules[i % 2];
+	quint32 station = names.find(schedule.stations[i]);
+
+	StopTimetable thisStop;
+	for (int day = 0; day < 2; day++) {
+	    RtdTimetableStore::Route route = store.route(names.find(QString::number(i)), 3, (i % 2) ? 'W' : 'E');
+	    int stop = route.findStation(station);
+	    if (stop < 0)
+		continue;
+
+	    QVector<quint32> subroutes = route.subroutes();
+	    StopTimetable dayTimetable;
+	    const quint16 *minutes = route.minutes(stop);
+	    const quint16 *subrouteIndexes = route.subrouteIndexes(stop);
+	    for (int j = 0; j < route.departureCount(stop); j++)
+		dayTimetable.append(minutes[j] + day * 1440, subroutes[subrouteIndexes[j]]);
+	    thisStop.merge(dayTimetable);
+	}
+	timetables << thisStop;
+    }
+
+    return timetables;
+}
+
+// what a NextStops source costs the first time round each day
+void RtdBenchmark::nextStopsBuild()
+{
+    RtdInternTable names;
+    RtdTimetableStore store(m_storePath, &names);
+    QDateTime now(QDate(2009, 8, 24), QTime(7, 30));
+
+    NextStopsCursor cursor;
+    AllocationCounter allocations;
+    StopTimetables timetables = stopTimetables(store, names);
+    cursor.reset(timetables, now.date(), store.validAsOf(), now);
+    cursor.next(now, NEXT_STOPS_N, names);
+    allocations.stop();
+
+    int departures = 0;
+    foreach (const StopTimetable& timetable, timetables)
+	departures += timetable.count();
+
+    Throughput throughput(departures, "departures");
+    QBENCHMARK {
+	cursor.reset(stopTimetables(store, names), now.date(), store.validAsOf(), now);
+	cursor.next(now, NEXT_STOPS_N, names);
+	throughput.run();
+    }
+    throughput.report(allocations);
+}
+
+// what it costs to keep a NextStops source up to date over a whole day
+void RtdBenchmark::nextStopsTick()
+{
+    RtdInternTable names;
+    RtdTimetableStore store(m_storePath, &names);
+    QDate today(2009, 8, 24);
+    StopTimetables timetables = stopTimetables(store, names);
+
+    NextStopsCursor cursor;
+    cursor.reset(timetables, today, store.validAsOf(), QDateTime(today, QTime(0, 0)));
+    AllocationCounter allocations;
+    for (QDateTime now = cursor.nextChange(); now.date() == today; now = cursor.nextChange())
+	cursor.next(now, NEXT_STOPS_N, names);
+    allocations.stop();
+
+    Throughput throughput(1, "days");
+    QBENCHMARK {
+	cursor.reset(timetables, today, store.validAsOf(), QDateTime(today, QTime(0, 0)));
+	for (QDateTime now = cursor.nextChange(); now.date() == today; now = cursor.nextChange())
+	    cursor.next(now, NEXT_STOPS_N, names);
+	throughput.run();
+    }
+    throughput.report(allocations);
+}
+
+QTEST_KDEMAIN_CORE(RtdBenchmark)
+
+#include "rtdbenchmark.moc"
@@ -0,0 +1,100 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "rtdbenchmarkutil.h"
+
+#include <QtTest/QtTest>
+
+#include <stdlib.h>
+
+static bool s_counting = false;
+static qint64 s_allocations = 0;
+static qint64 s_allocatedBytes = 0;
+
+// count every heap allocation, Qt's included, by standing in for malloc
+#ifdef __GLIBC__
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(size_t size)
+{
+    if (s_counting) {
+	s_allocations++;
+	s_allocatedBytes += size;
+    }
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    if (s_counting) {
+	s_allocations++;
+	s_allocatedBytes += count * size;
+    }
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (s_counting) {
+	s_allocations++;
+	s_allocatedBytes += size;
+    }
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+}
+#endif
+
+AllocationCounter::AllocationCounter()
+    : m_count(0),
+      m_bytes(0)
+{
+    s_allocations = 0;
+    s_allocatedBytes = 0;
+    s_counting = true;
+}
+
+AllocationCounter::~AllocationCounter()
+{
+    s_counting = false;
+}
+
+void AllocationCounter::stop()
+{
+    s_counting = false;
+    m_count = s_allocations;
+    m_bytes = s_allocatedBytes;
+}
+
+void Throughput::report(const AllocationCounter& allocations) const
+{
+    int msecs = qMax(m_timer.elapsed(), 1);
+    qDebug("%s: %lld %s per run, %.0f %s/s; %lld allocations (%lld bytes) per run",
+	   QTest::currentDataTag() ? QTest::currentDataTag() : "",
+	   m_units, m_unit, double(m_units) * m_runs * 1000 / msecs, m_unit,
+	   allocations.count(), allocations.bytes());
+}
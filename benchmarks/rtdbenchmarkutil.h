@@ -0,0 +1,58 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RTDBENCHMARKUTIL_H
+#define RTDBENCHMARKUTIL_H
+
+#include <QtCore/QTime>
+
+// the heap allocations made while one of these is alive, Qt's included; only
+// one may be alive at a time
+class AllocationCounter
+{
+    public:
+	AllocationCounter();
+	~AllocationCounter();
+
+	void stop();
+	qint64 count() const { return m_count; }
+	qint64 bytes() const { return m_bytes; }
+
+    private:
+	qint64 m_count;
+	qint64 m_bytes;
+};
+
+// times the runs of a QBENCHMARK block, to turn them into a throughput
+class Throughput
+{
+    public:
+	Throughput(qint64 units, const char *unit) : m_units(units), m_unit(unit), m_runs(0) { m_timer.start(); }
+
+	void run() { m_runs++; }
+	void report(const AllocationCounter& allocations) const;
+
+    private:
+	qint64 m_units;
+	const char *m_unit;
+	int m_runs;
+	QTime m_timer;
+};
+
+#endif
@@ -0,0 +1,124 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+// Writes out a synthetic network (see rtdsyntheticnetwork.h) of a given size:
+// as a route list and schedule pages that rtdreplayserver can serve in place
+// of RTD's, and/or as a timetable store that the engine can start up with.
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+
+#include <KDE/KAboutData>
+#include <KDE/KCmdLineArgs>
+#include <KDE/KLocalizedString>
+
+#include <stdio.h>
+
+#include "../rtdinterntable.h"
+#include "../rtdtimetablestore.h"
+#include "rtdsyntheticnetwork.h"
+
+static bool writeFile(const QString& fileName, const QByteArray& contents)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(contents) != contents.size()) {
+	fprintf(stderr, "can't write %s\n", qPrintable(fileName));
+	return false;
+    }
+    return true;
+}
+
+// routemenu.js, and schedule-<route>-<direction>-<service type>.html for
+// each route, direction and day
+static bool writePages(const RtdSyntheticNetwork& network, const QString& dirName)
+{
+    QDir dir;
+    if (!dir.mkpath(dirName)) {
+	fprintf(stderr, "can't create %s\n", qPrintable(dirName));
+	return false;
+    }
+    dir.setPath(dirName);
+
+    if (!writeFile(dir.filePath(QLatin1String("routemenu.js")), network.routeList()))
+	return false;
+
+    for (int route = 0; route < network.routeCount(); route++) {
+	for (int day = 1; day <= 3; day++) {
+	    for (int i = 0; i < 2; i++) {
+		char direction = (i ? 'W' : 'E');
+		QString name = QString(QLatin1String("schedule-%1-%2-%3.html"))
+			       .arg(network.routeName(route)).arg(QLatin1Char(direction)).arg(day);
+		if (!writeFile(dir.filePath(name), network.schedulePage(route, day, direction)))
+		    return false;
+	    }
+	}
+    }
+    return true;
+}
+
+static bool writeStore(const RtdSyntheticNetwork& network, const QString& fileName)
+{
+    RtdInternTable names;
+    RtdTimetableStore store(fileName, &names);
+    qint64 departures = network.fillStore(&store);
+    int epoch, generation;
+    if (!RtdTimetableStore::write(fileName, store.serialize(&epoch, &generation))) {
+	fprintf(stderr, "can't write %s\n", qPrintable(fileName));
+	return false;
+    }
+    fprintf(stderr, "%lld departures, %d names\n", departures, names.count());
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    KAboutData about("rtdgenerate", 0, ki18n("RTD network generator"), "0.1",
+		     ki18n("Generates synthetic transit networks for scaling tests of the rtddenver engine"),
+		     KAboutData::License_LGPL);
+
+    KCmdLineOptions options;
+    options.add("routes <count>", ki18n("Number of routes"), "150");
+    options.add("stations <count>", ki18n("Number of stations on each route"), "24");
+    options.add("trips <count>", ki18n("Number of trips each way on a weekday"), "60");
+    options.add("seed <n>", ki18n("Seed for the schedules' jitter"), "1");
+    options.add("pages <dir>", ki18n("Write a route list and schedule pages for rtdreplayserver to this directory"));
+    options.add("store <file>", ki18n("Write a timetable store to this file"));
+
+    KCmdLineArgs::init(argc, argv, &about);
+    KCmdLineArgs::addCmdLineOptions(options);
+    KCmdLineArgs *args = KCmdLineArgs::parsedArgs();
+    QCoreApplication app(KCmdLineArgs::qtArgc(), KCmdLineArgs::qtArgv());
+
+    if (!args->isSet("pages") && !args->isSet("store"))
+	KCmdLineArgs::usageError(i18n("Nothing to do: give --pages and/or --store"));
+
+    RtdSyntheticNetwork network(args->getOption("routes").toInt(), args->getOption("stations").toInt(),
+				args->getOption("trips").toInt(), args->getOption("seed").toUInt());
+    fprintf(stderr, "%d routes, %d stations\n", network.routeCount(), network.stationCount());
+
+    bool ok = true;
+    if (args->isSet("pages"))
+	ok = writePages(network, args->getOption("pages"));
+    if (ok && args->isSet("store"))
+	ok = writeStore(network, args->getOption("store"));
+    args->clear();
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,254 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+// Drives the installed rtddenver engine with hundreds of sources at once,
+// against rtdreplayserver rather than RTD itself, and checks that every one
+// of them is eventually answered: with data, or with an Error. It reports
+// how long the sources took to complete, and fails if any are left pending.
+//
+// It runs in a scratch KDEHOME, so the engine starts with a cold cache and
+// its configuration points at the replay server without touching the user's.
+
+#include <QtCore/QDir>
+#include <QtCore/QHash>
+#include <QtCore/QTime>
+#include <QtCore/QTimer>
+#include <QtCore/QtAlgorithms>
+
+#include <KDE/KAboutData>
+#include <KDE/KApplication>
+#include <KDE/KCmdLineArgs>
+#include <KDE/KConfig>
+#include <KDE/KConfigGroup>
+#include <KDE/KLocalizedString>
+#include <KDE/Plasma/DataEngine>
+#include <KDE/Plasma/DataEngineManager>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+enum {
+    DEFAULT_SOURCES = 200,
+    DEFAULT_TIMEOUT = 10*60,    // secs
+    NEXT_STOPS_N = 4
+};
+
+class LoadTest : public QObject
+{
+    Q_OBJECT
+
+    public:
+	LoadTest(Plasma::DataEngine *engine, int sourceCount, int timeout);
+
+    public slots:
+	void start();
+	void dataUpdated(const QString& sourceName, const Plasma::DataEngine::Data& data);
+
+    private slots:
+	void timedOut();
+
+    private:
+	void connectSources(const QStringList& routes);
+	void report();
+
+	Plasma::DataEngine *m_engine;
+	int m_sourceCount;
+	int m_timeout;
+	QTime m_clock;
+	QTimer m_timeoutTimer;
+
+	QHash<QString, int> m_started;      // pending source -> msecs since start
+	QList<int> m_latencies;
+	int m_errors;
+	bool m_routesSeen;
+};
+
+LoadTest::LoadTest(Plasma::DataEngine *engine, int sourceCount, int timeout)
+    : m_engine(engine),
+      m_sourceCount(sourceCount),
+      m_timeout(timeout),
+      m_errors(0),
+      m_routesSeen(false)
+{
+    m_timeoutTimer.setSingleShot(true);
+    connect(&m_timeoutTimer, SIGNAL(timeout()), this, SLOT(timedOut()));
+}
+
+void LoadTest::start()
+{
+    m_clock.start();
+    m_timeoutTimer.start(m_timeout * 1000);
+
+    // everything else waits on the route list, so get it first
+    m_engine->connectSource(QLatin1String("Routes"), this);
+}
+
+// a mix of what the applet asks for: whole schedules, the next few buses at
+// a stop, and route directions; the replay server answers B-family routes
+// with the B's page, and everything else with the 15's
+void LoadTest::connectSources(const QStringList& routes)
+{
+    QStringList sources;
+    for (int i = 0; sources.size() < m_sourceCount && i < routes.size() * 4; i++) {
+	const QString& route = routes[i % routes.size()];
+	QString station = (route.startsWith(QLatin1Char('B')) ? QLatin1String("US 36 & Table Mesa")
+							      : QLatin1String("Colfax & Broadway"));
+	switch (i / routes.size()) {
+	case 0:
+	    sources << QString(QLatin1String("ScheduleOf %1-E")).arg(route);
+	    break;
+	case 1:
+	    sources << QString(QLatin1String("NextStops [%1-E:%2] %3")).arg(route).arg(station).arg(int(NEXT_STOPS_N));
+	    break;
+	case 2:
+	    sources << QString(QLatin1String("DirectionOf %1")).arg(route);
+	    break;
+	default:
+	    sources << QString(QLatin1String("ScheduleOf %1-W TEXT")).arg(route);
+	    break;
+	}
+    }
+
+    fprintf(stderr, "connecting %d sources\n", sources.size());
+    foreach (const QString& sourceName, sources)
+	m_started.insert(sourceName, m_clock.elapsed());
+    foreach (const QString& sourceName, sources)
+	m_engine->connectSource(sourceName, this);
+}
+
+void LoadTest::dataUpdated(const QString& sourceName, const Plasma::DataEngine::Data& data)
+{
+    // still waiting on the network
+    if (data.isEmpty())
+	return;
+
+    if (sourceName == QLatin1String("Routes")) {
+	if (m_routesSeen)
+	    return;
+	m_routesSeen = true;
+	fprintf(stderr, "route list after %d ms\n", m_clock.elapsed());
+	connectSources(data.keys());
+	if (m_started.isEmpty())
+	    report();
+	return;
+    }
+
+    QHash<QString, int>::iterator it = m_started.find(sourceName);
+    if (it == m_started.end())
+	return;
+
+    m_latencies << m_clock.elapsed() - it.value();
+    if (data.contains(QLatin1String("Error")))
+	m_errors++;
+    m_started.erase(it);
+
+    if (m_started.isEmpty())
+	report();
+}
+
+void LoadTest::timedOut()
+{
+    report();
+}
+
+void LoadTest::report()
+{
+    m_timeoutTimer.stop();
+
+    if (!m_latencies.isEmpty()) {
+	qSort(m_latencies);
+	int count = m_latencies.size();
+	printf("%d sources completed (%d with errors) in %d ms\n", count, m_errors, m_clock.elapsed());
+	printf("completion time: p50 %d ms, p90 %d ms, p99 %d ms, max %d ms\n",
+	       m_latencies[count / 2], m_latencies[count * 9 / 10], m_latencies[count * 99 / 100],
+	       m_latencies.last());
+    }
+
+    // what the engine made of it
+    Plasma::DataEngine::Data stats = m_engine->query(QLatin1String("Stats"));
+    printf("fetches: %lld started, %lld coalesced, %lld failed, %d retries\n",
+	   stats.value(QLatin1String("fetchesStarted")).toLongLong(),
+	   stats.value(QLatin1String("fetchesCoalesced")).toLongLong(),
+	   stats.value(QLatin1String("fetchesFailed")).toLongLong(),
+	   stats.value(QLatin1String("fetchRetries")).toInt());
+
+    if (!m_routesSeen)
+	printf("the route list never arrived\n");
+    if (!m_started.isEmpty()) {
+	printf("%d sources still pending after %d s:\n", m_started.size(), m_timeout);
+	foreach (const QString& sourceName, m_started.keys())
+	    printf("    %s\n", qPrintable(sourceName));
+    }
+
+    QCoreApplication::exit(m_routesSeen && m_started.isEmpty() ? 0 : 1);
+}
+
+int main(int argc, char **argv)
+{
+    // the engine's cache and configuration go in a scratch KDEHOME, which has
+    // to be in place before anything of KDE's starts up
+    QByteArray kdeHome = QDir::tempPath().toLocal8Bit() + "/rtdloadtest-" + QByteArray::number(int(getpid()));
+    setenv("KDEHOME", kdeHome.constData(), 1);
+
+    KAboutData about("rtdloadtest", 0, ki18n("RTD engine load test"), "0.1",
+		     ki18n("Loads the rtddenver engine with concurrent sources served by rtdreplayserver"),
+		     KAboutData::License_LGPL);
+
+    KCmdLineOptions options;
+    options.add("url <url>", ki18n("Base URL of the replay server"), "http://localhost:8080/schedules/");
+    options.add("sources <count>", ki18n("Number of sources to connect"), QByteArray::number(int(DEFAULT_SOURCES)));
+    options.add("max-fetches <count>", ki18n("The engine's limit on concurrent fetches"), "");
+    options.add("timeout <secs>", ki18n("How long to wait for every source to complete"),
+		QByteArray::number(int(DEFAULT_TIMEOUT)));
+
+    KCmdLineArgs::init(argc, argv, &about);
+    KCmdLineArgs::addCmdLineOptions(options);
+    KCmdLineArgs *args = KCmdLineArgs::parsedArgs();
+
+    KApplication app(false);
+
+    {
+	KConfig config(QLatin1String("plasma_engine_rtddenverrc"));
+	KConfigGroup network(&config, "Network");
+	network.writeEntry("BaseUrl", args->getOption("url"));
+	// only the sources' own fetches, so that the numbers mean something
+	network.writeEntry("Prefetch", false);
+	if (!args->getOption("max-fetches").isEmpty())
+	    network.writeEntry("MaxFetches", args->getOption("max-fetches").toInt());
+	config.sync();
+    }
+
+    Plasma::DataEngine *engine = Plasma::DataEngineManager::self()->loadEngine(QLatin1String("rtddenver"));
+    if (!engine || !engine->isValid()) {
+	fprintf(stderr, "can't load the rtddenver engine: is it installed?\n");
+	return 1;
+    }
+
+    LoadTest test(engine, args->getOption("sources").toInt(), args->getOption("timeout").toInt());
+    args->clear();
+    // answers can come back from inside connectSource(), so wait for the event loop
+    QTimer::singleShot(0, &test, SLOT(start()));
+    int ret = app.exec();
+
+    Plasma::DataEngineManager::self()->unloadEngine(QLatin1String("rtddenver"));
+    return ret;
+}
+
+#include "rtdloadtest.moc"
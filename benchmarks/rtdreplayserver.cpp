@@ -0,0 +1,372 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+// A stand-in for RTD's web server, for load-testing the engine's fetch
+// pipeline: point the engine's [Network] BaseUrl at it, and it serves the
+// recorded pages in corpus/ with as much latency, as many server errors and
+// as many truncated bodies as it is told to.
+//
+// Schedule pages are rewritten so that the direction asked for is the one
+// listed, and every page carries an ETag so that conditional requests work.
+// A corpus made by rtdgenerate has a page for each route, direction and
+// service type, and those are served as they are.
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QRegExp>
+#include <QtCore/QTime>
+#include <QtCore/QTimer>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+
+#include <KDE/KAboutData>
+#include <KDE/KCmdLineArgs>
+#include <KDE/KLocalizedString>
+#include <KDE/KUrl>
+
+#include <stdio.h>
+
+enum {
+    DEFAULT_PORT = 8080,
+    MAX_REQUEST_BYTES = 16*1024
+};
+
+struct ReplayOptions {
+    QString corpusDir;
+    int minLatency;         // msecs
+    int maxLatency;
+    int errorRate;          // percent of requests
+    int truncateRate;
+    bool verbose;
+};
+
+struct ReplayResponse {
+    int status;
+    QByteArray reason;
+    QByteArray contentType;
+    QByteArray etag;
+    QByteArray body;
+    bool truncate;
+
+    ReplayResponse() : status(200), reason("OK"), truncate(false) { }
+};
+
+// the pages being served, read in as they are first asked for
+class ReplayCorpus
+{
+    public:
+	explicit ReplayCorpus(const QString& dir) : m_dir(dir) { }
+
+	bool contains(const QString& name) { return !page(name).isNull(); }
+	QByteArray page(const QString& name);
+
+    private:
+	QDir m_dir;
+	QHash<QString, QByteArray> m_pages;     // a null page for a file that isn't there
+};
+
+// one client connection: read a request, sit on it for a while, and answer
+class ReplayConnection : public QObject
+{
+    Q_OBJECT
+
+    public:
+	ReplayConnection(int socketDescriptor, const ReplayOptions *options, ReplayCorpus *corpus,
+			 QObject *parent);
+
+    private slots:
+	void readRequest();
+	void respond();
+
+    private:
+	ReplayResponse responseFor(const QByteArray& path, const QByteArray& ifNoneMatch);
+
+	const ReplayOptions *m_options;
+	ReplayCorpus *m_corpus;
+	QTcpSocket *m_socket;
+	QByteArray m_request;
+	ReplayResponse m_response;
+};
+
+class ReplayServer : public QTcpServer
+{
+    public:
+	ReplayServer(const ReplayOptions& options);
+
+    protected:
+	void incomingConnection(int socketDescriptor);
+
+    private:
+	ReplayOptions m_options;
+	ReplayCorpus m_corpus;
+};
+
+static bool chance(int percent)
+{
+    return percent > 0 && qrand() % 100 < percent;
+}
+
+static QByteArray etagOf(const QByteArray& body)
+{
+    return '"' + QCryptographicHash::hash(body, QCryptographicHash::Md5).toHex() + '"';
+}
+
+// the recorded pages list one direction and link to the other: make the
+// direction in @p code ("E-Bound", "Clock"...) the listed one, if the page has it
+static QByteArray forDirection(const QByteArray& page, const QString& code)
+{
+    static const char *const names[] = { "North", "South", "East", "West" };
+
+    QString wanted;
+    for (int i = 0; i < 4; i++) {
+	if (code.startsWith(QLatin1Char(names[i][0])))
+	    wanted = QLatin1String(names[i]);
+    }
+    if (wanted.isEmpty())
+	return page;
+
+    QString html = QString::fromUtf8(page);
+    QRegExp header(QLatin1String("<td class=\"scheduleHeaderBlueHilite\">(?:<a [^>]*>)?"
+				 "(North|South|East|West) Bound(?:</a>)?</td>"));
+    if (!html.contains(QString(QLatin1String("%1 Bound")).arg(wanted)))
+	return page;
+
+    QString ret;
+    int pos = 0;
+    int match;
+    while ((match = header.indexIn(html, pos)) >= 0) {
+	ret += html.midRef(pos, match - pos);
+	QString direction = header.cap(1);
+	if (direction == wanted) {
+	    ret += QString(QLatin1String("<td class=\"scheduleHeaderBlueHilite\">%1 Bound</td>")).arg(direction);
+	} else {
+	    ret += QString(QLatin1String("<td class=\"scheduleHeaderBlueHilite\"><a href=\"getSchedule.action?"
+					 "direction=%1-Bound\">%2 Bound</a></td>")).arg(direction.at(0)).arg(direction);
+	}
+	pos = match + header.matchedLength();
+    }
+    ret += html.midRef(pos);
+
+    return ret.toUtf8();
+}
+
+QByteArray ReplayCorpus::page(const QString& name)
+{
+    QHash<QString, QByteArray>::const_iterator it = m_pages.constFind(name);
+    if (it != m_pages.constEnd())
+	return it.value();
+
+    QByteArray contents;
+    QFile file(m_dir.filePath(name));
+    if (file.open(QIODevice::ReadOnly)) {
+	contents = file.readAll();
+	// an empty file is still there
+	if (contents.isNull())
+	    contents = QByteArray("");
+    }
+    m_pages.insert(name, contents);
+    return contents;
+}
+
+ReplayConnection::ReplayConnection(int socketDescriptor, const ReplayOptions *options, ReplayCorpus *corpus,
+				   QObject *parent)
+    : QObject(parent),
+      m_options(options),
+      m_corpus(corpus),
+      m_socket(new QTcpSocket(this))
+{
+    connect(m_socket, SIGNAL(readyRead()), this, SLOT(readRequest()));
+    connect(m_socket, SIGNAL(disconnected()), this, SLOT(deleteLater()));
+    m_socket->setSocketDescriptor(socketDescriptor);
+}
+
+void ReplayConnection::readRequest()
+{
+    m_request += m_socket->readAll();
+    int headerEnd = m_request.indexOf("\r\n\r\n");
+    if (headerEnd < 0) {
+	if (m_request.size() > MAX_REQUEST_BYTES)
+	    m_socket->abort();
+	return;
+    }
+    disconnect(m_socket, SIGNAL(readyRead()), this, SLOT(readRequest()));
+
+    QList<QByteArray> lines = m_request.left(headerEnd).split('\n');
+    QList<QByteArray> requestLine = lines.first().trimmed().split(' ');
+    QByteArray path = (requestLine.size() >= 2 ? requestLine[1] : QByteArray());
+    QByteArray ifNoneMatch;
+    for (int i = 1; i < lines.size(); i++) {
+	int colon = lines[i].indexOf(':');
+	if (colon > 0 && lines[i].left(colon).trimmed().toLower() == "if-none-match")
+	    ifNoneMatch = lines[i].mid(colon + 1).trimmed();
+    }
+
+    m_response = responseFor(path, ifNoneMatch);
+    if (m_options->verbose) {
+	fprintf(stderr, "%s %d%s %s\n", qPrintable(QTime::currentTime().toString(QLatin1String("hh:mm:ss.zzz"))),
+		m_response.status, m_response.truncate ? " (truncated)" : "", path.constData());
+    }
+
+    int latency = m_options->minLatency;
+    if (m_options->maxLatency > m_options->minLatency)
+	latency += qrand() % (m_options->maxLatency - m_options->minLatency + 1);
+    QTimer::singleShot(latency, this, SLOT(respond()));
+}
+
+void ReplayConnection::respond()
+{
+    QByteArray head = "HTTP/1.1 " + QByteArray::number(m_response.status) + ' ' + m_response.reason + "\r\n";
+    head += "Date: " + QDateTime::currentDateTime().toUTC().toString(QLatin1String("ddd, dd MMM yyyy hh:mm:ss 'GMT'")).toLatin1() + "\r\n";
+    if (!m_response.contentType.isEmpty())
+	head += "Content-Type: " + m_response.contentType + "\r\n";
+    if (!m_response.etag.isEmpty())
+	head += "ETag: " + m_response.etag + "\r\n";
+    head += "Content-Length: " + QByteArray::number(m_response.body.size()) + "\r\n";
+    head += "Connection: close\r\n\r\n";
+    m_socket->write(head);
+
+    // a truncated body promises the whole page but hangs up halfway through it
+    if (m_response.truncate) {
+	m_socket->write(m_response.body.left(m_response.body.size() / 2));
+	m_socket->flush();
+	m_socket->abort();
+	return;
+    }
+
+    m_socket->write(m_response.body);
+    m_socket->disconnectFromHost();
+}
+
+ReplayResponse ReplayConnection::responseFor(const QByteArray& path, const QByteArray& ifNoneMatch)
+{
+    ReplayResponse response;
+
+    if (chance(m_options->errorRate)) {
+	bool unavailable = qrand() % 2;
+	response.status = (unavailable ? 503 : 500);
+	response.reason = (unavailable ? "Service Unavailable" : "Internal Server Error");
+	response.contentType = "text/html";
+	response.body = "<html><body>" + response.reason + "</body></html>\n";
+	return response;
+    }
+
+    KUrl url(QLatin1String("http://localhost") + QString::fromLatin1(path));
+    QString file = url.fileName();
+    QString routeId = url.queryItem(QLatin1String("routeId"));
+    QString direction = url.queryItem(QLatin1String("direction"));
+    // a page asked for without a direction lists its first one
+    QString generated = QString(QLatin1String("schedule-%1-%2-%3.html"))
+			.arg(routeId).arg(direction.isEmpty() ? QString(QLatin1String("E")) : direction.left(1))
+			.arg(url.queryItem(QLatin1String("serviceType")));
+    if (file == QLatin1String("getAjaxRouteMenu.action") && m_corpus->contains(QLatin1String("routemenu.js"))) {
+	response.contentType = "text/javascript";
+	response.body = m_corpus->page(QLatin1String("routemenu.js"));
+    } else if (file == QLatin1String("getSchedule.action") && m_corpus->contains(generated)) {
+	response.contentType = "text/html";
+	response.body = m_corpus->page(generated);
+    } else if (file == QLatin1String("getSchedule.action") &&
+	       m_corpus->contains(QLatin1String("schedule-15-E-weekday.html"))) {
+	// the B family has its own page with subroutes; everything else runs like the 15
+	QString page = (routeId.startsWith(QLatin1Char('B')) ? QLatin1String("schedule-B-W-weekday.html")
+							     : QLatin1String("schedule-15-E-weekday.html"));
+	response.contentType = "text/html";
+	response.body = forDirection(m_corpus->page(page), direction);
+    } else {
+	response.status = 404;
+	response.reason = "Not Found";
+	response.contentType = "text/html";
+	response.body = "<html><body>Not Found</body></html>\n";
+	return response;
+    }
+
+    response.etag = etagOf(response.body);
+    if (!ifNoneMatch.isEmpty() && ifNoneMatch == response.etag) {
+	response.status = 304;
+	response.reason = "Not Modified";
+	response.body.clear();
+	return response;
+    }
+
+    response.truncate = chance(m_options->truncateRate);
+    return response;
+}
+
+ReplayServer::ReplayServer(const ReplayOptions& options)
+    : m_options(options),
+      m_corpus(options.corpusDir)
+{
+}
+
+void ReplayServer::incomingConnection(int socketDescriptor)
+{
+    new ReplayConnection(socketDescriptor, &m_options, &m_corpus, this);
+}
+
+int main(int argc, char **argv)
+{
+    KAboutData about("rtdreplayserver", 0, ki18n("RTD replay server"), "0.1",
+		     ki18n("Serves recorded RTD pages to the rtddenver engine for load testing"),
+		     KAboutData::License_LGPL);
+
+    KCmdLineOptions options;
+    options.add("port <port>", ki18n("Port to listen on"), QByteArray::number(int(DEFAULT_PORT)));
+    options.add("corpus <dir>", ki18n("Directory of recorded pages"), RTD_CORPUS_DIR);
+    options.add("min-latency <msecs>", ki18n("Least time to sit on a request"), "0");
+    options.add("max-latency <msecs>", ki18n("Most time to sit on a request"), "0");
+    options.add("errors <percent>", ki18n("Share of requests answered with a server error"), "0");
+    options.add("truncate <percent>", ki18n("Share of pages cut off halfway through"), "0");
+    options.add("verbose", ki18n("Log each request"));
+
+    KCmdLineArgs::init(argc, argv, &about);
+    KCmdLineArgs::addCmdLineOptions(options);
+    KCmdLineArgs *args = KCmdLineArgs::parsedArgs();
+
+    QCoreApplication app(KCmdLineArgs::qtArgc(), KCmdLineArgs::qtArgv());
+    qsrand(QDateTime::currentDateTime().toTime_t());
+
+    ReplayOptions replay;
+    replay.corpusDir = args->getOption("corpus");
+    replay.minLatency = args->getOption("min-latency").toInt();
+    replay.maxLatency = qMax(args->getOption("max-latency").toInt(), replay.minLatency);
+    replay.errorRate = args->getOption("errors").toInt();
+    replay.truncateRate = args->getOption("truncate").toInt();
+    replay.verbose = args->isSet("verbose");
+
+    if (!QFile::exists(QDir(replay.corpusDir).filePath(QLatin1String("routemenu.js")))) {
+	fprintf(stderr, "no routemenu.js in %s\n", qPrintable(replay.corpusDir));
+	return 1;
+    }
+
+    ReplayServer server(replay);
+    if (!server.listen(QHostAddress::LocalHost, args->getOption("port").toUShort())) {
+	fprintf(stderr, "can't listen: %s\n", qPrintable(server.errorString()));
+	return 1;
+    }
+    fprintf(stderr, "serving %s at http://localhost:%d/schedules/\n",
+	    qPrintable(replay.corpusDir), int(server.serverPort()));
+    args->clear();
+
+    return app.exec();
+}
+
+#include "rtdreplayserver.moc"
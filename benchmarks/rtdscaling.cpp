@@ -0,0 +1,326 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+// How the engine's caches scale as the network grows past RTD's: each
+// benchmark runs against synthetic networks of increasing size, and reports
+// its throughput, its heap allocations and, for the store, the footprint of
+// a loaded network.
+
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QHash>
+#include <QtTest/QtTest>
+
+#include <qtest_kde.h>
+
+#include "../rtddepartures.h"
+#include "../rtdinterntable.h"
+#include "../rtdscheduleparser.h"
+#include "../rtdtimetablestore.h"
+#include "rtdbenchmarkutil.h"
+#include "rtdsyntheticnetwork.h"
+
+enum {
+    BASE_ROUTES = 150,          // about the size of RTD's network...
+    BASE_STATIONS = 24,         // ... and of one of its busier routes
+    BASE_TRIPS = 60,
+    NEXT_STOPS_N = 4
+};
+
+class RtdScaling : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+	void cleanupTestCase();
+
+	void parsePage_data();
+	void parsePage();
+	void storeWrite_data();
+	void storeWrite();
+	void storeOpen_data();
+	void storeOpen();
+	void nextStopsBuild_data();
+	void nextStopsBuild();
+	void nextStopsTick_data();
+	void nextStopsTick();
+
+    private:
+	void addNetworkRows();
+	RtdSyntheticNetwork network() const;
+	QString storeFor(const RtdSyntheticNetwork& network);
+	StopTimetables stopTimetables(const RtdSyntheticNetwork& network, const RtdTimetableStore& store,
+				      const RtdInternTable& names) const;
+
+	QHash<QString, QString> m_stores;   // data tag -> store file
+};
+
+// the networks to try: RTD-sized, then several agencies' worth, then busier too
+void RtdScaling::addNetworkRows()
+{
+    QTest::addColumn<int>("routes");
+    QTest::addColumn<int>("stations");
+    QTest::addColumn<int>("trips");
+
+    QTest::newRow("1x") << int(BASE_ROUTES) << int(BASE_STATIONS) << int(BASE_TRIPS);
+    QTest::newRow("2x routes") << 2 * BASE_ROUTES << int(BASE_STATIONS) << int(BASE_TRIPS);
+    QTest::newRow("5x routes") << 5 * BASE_ROUTES << int(BASE_STATIONS) << int(BASE_TRIPS);
+    QTest::newRow("10x routes") << 10 * BASE_ROUTES << int(BASE_STATIONS) << int(BASE_TRIPS);
+    QTest::newRow("10x routes, 2x stations and trips") << 10 * BASE_ROUTES << 2 * BASE_STATIONS << 2 * BASE_TRIPS;
+}
+
+RtdSyntheticNetwork RtdScaling::network() const
+{
+    QFETCH(int, routes);
+    QFETCH(int, stations);
+    QFETCH(int, trips);
+    return RtdSyntheticNetwork(routes, stations, trips);
+}
+
+// the current row's network, written out as a store the first time it's wanted
+QString RtdScaling::storeFor(const RtdSyntheticNetwork& network)
+{
+    QString tag = QLatin1String(QTest::currentDataTag());
+    if (m_stores.contains(tag))
+	return m_stores[tag];
+
+    QString path = QDir::tempPath() + QString(QLatin1String("/rtdscaling-%1.dat")).arg(m_stores.size());
+    RtdInternTable names;
+    RtdTimetableStore store(path, &names);
+    network.fillStore(&store);
+    int epoch, generation;
+    if (!RtdTimetableStore::write(path, store.serialize(&epoch, &generation)))
+	qFatal("can't write %s", qPrintable(path));
+
+    m_stores.insert(tag, path);
+    return path;
+}
+
+void RtdScaling::cleanupTestCase()
+{
+    foreach (const QString& path, m_stores)
+	QFile::remove(path);
+}
+
+void RtdScaling::parsePage_data()
+{
+    addNetworkRows();
+}
+
+// one route's page, which grows with the stations and trips but not the routes
+void RtdScaling::parsePage()
+{
+    RtdSyntheticNetwork net = network();
+    QByteArray html = net.schedulePage(0, 3, 'E');
+    QString routeName = net.routeName(0);
+
+    // the generator and the parser had better agree
+    RtdSchedulePage page = RtdScheduleParser::parse(html, routeName);
+    RtdSchedule expected = net.schedule(0, 3, 'E');
+    QCOMPARE(int(page.status), int(RtdSchedulePage::Found));
+    QCOMPARE(page.schedule.stations, expected.stations);
+    QCOMPARE(page.schedule.stopStarts, expected.stopStarts);
+    QCOMPARE(page.schedule.minutes, expected.minutes);
+
+    AllocationCounter allocations;
+    RtdScheduleParser::parse(html, routeName);
+    allocations.stop();
+
+    Throughput throughput(html.size(), "bytes");
+    QBENCHMARK {
+	RtdScheduleParser::parse(html, routeName);
+	throughput.run();
+    }
+    throughput.report(allocations);
+}
+
+void RtdScaling::storeWrite_data()
+{
+    addNetworkRows();
+}
+
+// filing the whole network and writing it out, as a WarmCache ends up doing
+void RtdScaling::storeWrite()
+{
+    RtdSyntheticNetwork net = network();
+    QString path = QDir::tempPath() + QLatin1String("/rtdscaling-write.dat");
+    qint64 departures;
+
+    AllocationCounter allocations;
+    {
+	RtdInternTable names;
+	RtdTimetableStore store(path, &names);
+	departures = net.fillStore(&store);
+	int epoch, generation;
+	RtdTimetableStore::write(path, store.serialize(&epoch, &generation));
+    }
+    allocations.stop();
+
+    Throughput throughput(departures, "departures");
+    QBENCHMARK {
+	QFile::remove(path);
+	RtdInternTable names;
+	RtdTimetableStore store(path, &names);
+	net.fillStore(&store);
+	int epoch, generation;
+	RtdTimetableStore::write(path, store.serialize(&epoch, &generation));
+	throughput.run();
+    }
+    throughput.report(allocations);
+    QFile::remove(path);
+}
+
+void RtdScaling::storeOpen_data()
+{
+    addNetworkRows();
+}
+
+// the engine's startup cost, and what a loaded network costs to keep around:
+// the mapping of the file, plus the intern table that's filled from it
+void RtdScaling::storeOpen()
+{
+    RtdSyntheticNetwork net = network();
+    QString path = storeFor(net);
+
+    int names;
+    AllocationCounter allocations;
+    {
+	RtdInternTable table;
+	RtdTimetableStore store(path, &table);
+	names = table.count();
+    }
+    allocations.stop();
+
+    qDebug("%s: %d routes, %d stations; %lld bytes mapped, %lld bytes of heap, %d names",
+	   QTest::currentDataTag(), net.routeCount(), net.stationCount(), QFileInfo(path).size(),
+	   allocations.bytes(), names);
+
+    Throughput throughput(1, "stores");
+    QBENCHMARK {
+	RtdInternTable table;
+	RtdTimetableStore store(path, &table);
+	QVERIFY(store.validAsOf().isValid());
+	throughput.run();
+    }
+    throughput.report(allocations);
+}
+
+// today's and tomorrow's departures at one stop on each of a few routes spread
+// across the network, loaded the way the engine does for a NextStops query
+StopTimetables RtdScaling::stopTimetables(const RtdSyntheticNetwork& network, const RtdTimetableStore& store,
+					  const RtdInternTable& names) const
+{
+    StopTimetables timetables;
+    for (int i = 0; i < NEXT_STOPS_N; i++) {
+	int routeIndex = i * network.routeCount() / NEXT_STOPS_N;
+	quint32 routeId = names.find(network.routeName(routeIndex));
+	quint32 station = names.find(network.stationName(network.stationOf(routeIndex, i)));
+
+	StopTimetable thisStop;
+	for (int day = 0; day < 2; day++) {
+	    RtdTimetableStore::Route route = store.route(routeId, 3, (i % 2) ? 'W' : 'E');
+	    int stop = route.findStation(station);
+	    if (stop < 0)
+		continue;
+	    QVector<quint32> subroutes = route.subroutes();
+	    StopTimetable dayTimetable;
+	    const quint16 *minutes = route.minutes(stop);
+	    const quint16 *subrouteIndexes = route.subrouteIndexes(stop);
+	    for (int j = 0; j < route.departureCount(stop); j++)
+		dayTimetable.append(minutes[j] + day * 1440, subroutes[subrouteIndexes[j]]);
+	    thisStop.merge(dayTimetable);
+	}
+	timetables << thisStop;
+    }
+
+    return timetables;
+}
+
+void RtdScaling::nextStopsBuild_data()
+{
+    addNetworkRows();
+}
+
+// the latency of a NextStops source the first time round each day
+void RtdScaling::nextStopsBuild()
+{
+    RtdSyntheticNetwork net = network();
+    RtdInternTable names;
+    RtdTimetableStore store(storeFor(net), &names);
+    QDateTime now(QDate(2009, 8, 24), QTime(7, 30));
+
+    NextStopsCursor cursor;
+    AllocationCounter allocations;
+    StopTimetables timetables = stopTimetables(net, store, names);
+    cursor.reset(timetables, now.date(), store.validAsOf(), now);
+    QCOMPARE(cursor.next(now, NEXT_STOPS_N, names).size(), int(NEXT_STOPS_N));
+    allocations.stop();
+
+    int departures = 0;
+    foreach (const StopTimetable& timetable, timetables)
+	departures += timetable.count();
+
+    Throughput throughput(departures, "departures");
+    QBENCHMARK {
+	cursor.reset(stopTimetables(net, store, names), now.date(), store.validAsOf(), now);
+	cursor.next(now, NEXT_STOPS_N, names);
+	throughput.run();
+    }
+    throughput.report(allocations);
+}
+
+void RtdScaling::nextStopsTick_data()
+{
+    addNetworkRows();
+}
+
+// keeping a NextStops source up to date over a whole day
+void RtdScaling::nextStopsTick()
+{
+    RtdSyntheticNetwork net = network();
+    RtdInternTable names;
+    RtdTimetableStore store(storeFor(net), &names);
+    QDate today(2009, 8, 24);
+    StopTimetables timetables = stopTimetables(net, store, names);
+
+    NextStopsCursor cursor;
+    cursor.reset(timetables, today, store.validAsOf(), QDateTime(today, QTime(0, 0)));
+    AllocationCounter allocations;
+    for (QDateTime now = cursor.nextChange(); now.date() == today; now = cursor.nextChange())
+	cursor.next(now, NEXT_STOPS_N, names);
+    allocations.stop();
+
+    int departures = 0;
+    foreach (const StopTimetable& timetable, timetables)
+	departures += timetable.count();
+
+    Throughput throughput(departures, "departures");
+    QBENCHMARK {
+	cursor.reset(timetables, today, store.validAsOf(), QDateTime(today, QTime(0, 0)));
+	for (QDateTime now = cursor.nextChange(); now.date() == today; now = cursor.nextChange())
+	    cursor.next(now, NEXT_STOPS_N, names);
+	throughput.run();
+    }
+    throughput.report(allocations);
+}
+
+QTEST_KDEMAIN_CORE(RtdScaling)
+
+#include "rtdscaling.moc"
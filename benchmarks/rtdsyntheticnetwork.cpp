@@ -0,0 +1,279 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "rtdsyntheticnetwork.h"
+
+#include <QtCore/QPair>
+#include <QtCore/QtAlgorithms>
+
+#include "../rtdtimetablestore.h"
+
+enum {
+    ROUTES_PER_AGENCY = 100,
+    SERVICE_START = 5*60,       // the first bus leaves at 5:00 AM...
+    SERVICE_SPAN = 19*60 + 30,  // ... and the last at 12:30 AM
+    EXPRESS_EVERY = 4           // every fourth trip is an express, skipping every other stop
+};
+
+static const char *const streets[] = {
+    "Colfax", "Broadway", "Colorado", "Federal", "Sheridan", "Wadsworth", "Alameda", "Evans",
+    "Hampden", "Speer", "Lincoln", "Downing", "York", "Monaco", "Quebec", "Havana", 0
+};
+
+// RTD's way of writing a time: "530A", "1205P"
+static QString rtdTime(int minute)
+{
+    minute %= 1440;
+    int hr = (minute / 60) % 12;
+    return QString(QLatin1String("%1%2%3")).arg(hr ? hr : 12).arg(minute % 60, 2, 10, QLatin1Char('0'))
+					   .arg(QLatin1Char(minute >= 12*60 ? 'P' : 'A'));
+}
+
+static QString htmlEscape(const QString& s)
+{
+    QString ret = s;
+    ret.replace(QLatin1Char('&'), QLatin1String("&amp;"));
+    ret.replace(QLatin1Char('<'), QLatin1String("&lt;"));
+    return ret;
+}
+
+RtdSyntheticNetwork::RtdSyntheticNetwork(int routes, int stationsPerRoute, int tripsPerDay, uint seed)
+    : m_routes(qMax(routes, 1)),
+      m_stationsPerRoute(qMax(stationsPerRoute, 2)),
+      m_tripsPerDay(qMax(tripsPerDay, 1)),
+      m_seed(seed)
+{
+    // each route shares its first half of stations with the route before it
+    int half = m_stationsPerRoute / 2;
+    m_stationPool = (m_routes - 1) * half + m_stationsPerRoute;
+}
+
+// a cheap, well-mixed hash of the seed and three numbers, for the jitter
+// that keeps the network from being too regular
+uint RtdSyntheticNetwork::hash(uint a, uint b, uint c) const
+{
+    uint h = m_seed * 0x9e3779b9u;
+    h ^= a + 0x7f4a7c15u + (h << 6) + (h >> 2);
+    h ^= b + 0x7f4a7c15u + (h << 6) + (h >> 2);
+    h ^= c + 0x7f4a7c15u + (h << 6) + (h >> 2);
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    return h;
+}
+
+// a hundred routes to an agency, named "A1" to "A100", "B1"..., "AA1"...
+QString RtdSyntheticNetwork::routeName(int route) const
+{
+    QString agency;
+    int a = route / ROUTES_PER_AGENCY;
+    do {
+	agency.prepend(QLatin1Char('A' + a % 26));
+	a = a / 26 - 1;
+    } while (a >= 0);
+    return agency + QString::number(route % ROUTES_PER_AGENCY + 1);
+}
+
+QString RtdSyntheticNetwork::stationName(int station) const
+{
+    int streetCount = 0;
+    while (streets[streetCount])
+	streetCount++;
+    return QString(QLatin1String("%1 & %2th Ave")).arg(QLatin1String(streets[station % streetCount]))
+						  .arg(station / streetCount + 1);
+}
+
+int RtdSyntheticNetwork::stationOf(int route, int stop) const
+{
+    return route * (m_stationsPerRoute / 2) + stop;
+}
+
+int RtdSyntheticNetwork::tripCount(int day) const
+{
+    // a Saturday has two thirds of a weekday's service, a Sunday half
+    if (day == 1)
+	return qMax(m_tripsPerDay * 2 / 3, 1);
+    if (day == 2)
+	return qMax(m_tripsPerDay / 2, 1);
+    return m_tripsPerDay;
+}
+
+int RtdSyntheticNetwork::tripStart(int route, int day, int trip) const
+{
+    int trips = tripCount(day);
+    int headway = qMax(SERVICE_SPAN / trips, 1);
+    return SERVICE_START + int(hash(route, 0, 0) % uint(headway)) + trip * SERVICE_SPAN / trips +
+	   int(hash(route, day, trip) % 3);
+}
+
+// two to four minutes between stations, the same both ways
+QVector<int> RtdSyntheticNetwork::travelTimes(int route, int direction) const
+{
+    QVector<int> times(m_stationsPerRoute);
+    int elapsed = 0;
+    for (int i = 0; i < m_stationsPerRoute; i++) {
+	int stop = (direction == 'W' ? m_stationsPerRoute - 1 - i : i);
+	times[stop] = elapsed;
+	int segment = (direction == 'W' ? stop - 1 : stop);
+	elapsed += 2 + int(hash(route, segment, 1) % 3);
+    }
+    return times;
+}
+
+static bool isExpress(int trip)
+{
+    return trip % EXPRESS_EVERY == EXPRESS_EVERY - 1;
+}
+
+bool RtdSyntheticNetwork::stopsAt(int trip, int stop) const
+{
+    return !isExpress(trip) || stop % 2 == 0 || stop == m_stationsPerRoute - 1;
+}
+
+QString RtdSyntheticNetwork::subrouteOf(int route, int trip) const
+{
+    return (isExpress(trip) ? routeName(route) + QLatin1Char('X') : routeName(route));
+}
+
+RtdSchedule RtdSyntheticNetwork::schedule(int route, int day, int direction) const
+{
+    RtdSchedule schedule;
+    schedule.subroutes << routeName(route) << routeName(route) + QLatin1Char('X');
+
+    QList<QPair<QString, int> > stations;
+    for (int stop = 0; stop < m_stationsPerRoute; stop++)
+	stations << qMakePair(stationName(stationOf(route, stop)), stop);
+    qSort(stations);
+
+    QVector<int> travel = travelTimes(route, direction);
+    int trips = tripCount(day);
+    QVector<int> starts(trips);
+    for (int trip = 0; trip < trips; trip++)
+	starts[trip] = tripStart(route, day, trip);
+
+    schedule.stopStarts.reserve(m_stationsPerRoute + 1);
+    schedule.minutes.reserve(m_stationsPerRoute * trips);
+    schedule.subrouteIndexes.reserve(m_stationsPerRoute * trips);
+    for (int i = 0; i < stations.size(); i++) {
+	int stop = stations[i].second;
+	schedule.stations << stations[i].first;
+
+	QList<QPair<int, int> > departures;
+	for (int trip = 0; trip < trips; trip++) {
+	    if (stopsAt(trip, stop))
+		departures << qMakePair(starts[trip] + travel[stop], isExpress(trip) ? 1 : 0);
+	}
+	// the jitter can swap a pair of buses
+	qSort(departures);
+	for (int j = 0; j < departures.size(); j++) {
+	    schedule.minutes.append(departures[j].first);
+	    schedule.subrouteIndexes.append(departures[j].second);
+	}
+	schedule.stopStarts.append(schedule.minutes.size());
+    }
+
+    return schedule;
+}
+
+QByteArray RtdSyntheticNetwork::routeList() const
+{
+    QByteArray ret = "/* getAjaxRouteMenu.action */\nvar routeMenu = [\n";
+    for (int route = 0; route < m_routes; route++) {
+	QByteArray name = routeName(route).toLatin1();
+	ret += "  { text: \"" + name + "\", url: \"/schedules/getSchedule.action?runboardId=153&routeId=" + name +
+	       "\", group: \"Local\" },\n";
+    }
+    ret += "];\n";
+    return ret;
+}
+
+// a page in the same shape as RTD's, with a row per trip in the order they
+// leave and a column per station in the order they're passed
+QByteArray RtdSyntheticNetwork::schedulePage(int route, int day, int direction) const
+{
+    static const char *const dayNames[] = { "", "Saturday", "Sunday/Holiday", "Weekday" };
+    QString name = routeName(route);
+    QString other = QLatin1String(direction == 'W' ? "E" : "W");
+
+    QString html;
+    html += QLatin1String("<!DOCTYPE html PUBLIC \"-//W3C//DTD HTML 4.01 Transitional//EN\">\n"
+			  "<html>\n<head>\n<title>RTD - Schedules</title>\n</head>\n<body>\n<div id=\"content\">\n");
+    html += QString(QLatin1String("<p class=\"bodyBlueHeadline\">Route %1/%1X &mdash; %2 Schedule\n"))
+	    .arg(name).arg(QLatin1String(dayNames[qBound(1, day, 3)]));
+    // always in English, whatever the locale, as RTD writes it
+    static const char *const months[] = {
+	"January", "February", "March", "April", "May", "June", "July",
+	"August", "September", "October", "November", "December"
+    };
+    QDate date = validAsOf();
+    html += QString(QLatin1String("<p class=\"bodyBlueHeadline\">Schedule effective as of %1 %2, %3</p>\n"))
+	    .arg(QLatin1String(months[date.month() - 1])).arg(date.day()).arg(date.year());
+
+    html += QLatin1String("<table class=\"scheduleHeader\" cellspacing=\"0\"><tr>\n");
+    QString listed = QLatin1String(direction == 'W' ? "West" : "East");
+    QString linked = QLatin1String(direction == 'W' ? "East" : "West");
+    QString link = QString(QLatin1String("<td class=\"scheduleHeaderBlueHilite\"><a href=\"getSchedule.action?"
+					 "routeId=%1&amp;serviceType=%2&amp;direction=%3-Bound\">%4 Bound</a></td>\n"))
+		   .arg(name).arg(day).arg(other).arg(linked);
+    QString plain = QString(QLatin1String("<td class=\"scheduleHeaderBlueHilite\">%1 Bound</td>\n")).arg(listed);
+    html += (direction == 'W' ? link + plain : plain + link);
+    html += QLatin1String("</tr></table>\n");
+
+    html += QLatin1String("<table class=\"schedule\" cellspacing=\"0\" cellpadding=\"2\">\n<tr class=\"headrow\">\n"
+			  "<td><div class=\"scheduleTimesGrey\">Route</div></td>\n");
+    QVector<int> order;
+    for (int i = 0; i < m_stationsPerRoute; i++)
+	order << (direction == 'W' ? m_stationsPerRoute - 1 - i : i);
+    foreach (int stop, order) {
+	html += QString(QLatin1String("<td><div class=\"scheduleStations\">%1</div></td>\n"))
+		.arg(htmlEscape(stationName(stationOf(route, stop))));
+    }
+    html += QLatin1String("</tr>\n");
+
+    QVector<int> travel = travelTimes(route, direction);
+    for (int trip = 0; trip < tripCount(day); trip++) {
+	int start = tripStart(route, day, trip);
+	html += QString(QLatin1String("<tr class=\"row\"><td><div class=\"scheduleTimesGrey\">%1 </div>"))
+		.arg(subrouteOf(route, trip));
+	foreach (int stop, order) {
+	    html += QLatin1String("<td>");
+	    html += (stopsAt(trip, stop) ? rtdTime(start + travel[stop]) : QString(QLatin1String("--")));
+	}
+	html += QLatin1Char('\n');
+    }
+    html += QLatin1String("</table>\n</div>\n</body>\n</html>\n");
+
+    return html.toUtf8();
+}
+
+qint64 RtdSyntheticNetwork::fillStore(RtdTimetableStore *store) const
+{
+    qint64 departures = 0;
+    store->setValidAsOf(validAsOf());
+    for (int route = 0; route < m_routes; route++) {
+	for (int day = 1; day <= 3; day++) {
+	    RtdSchedule east = schedule(route, day, 'E');
+	    RtdSchedule west = schedule(route, day, 'W');
+	    store->insert(routeName(route), day, 'E', east);
+	    store->insert(routeName(route), day, 'W', west);
+	    departures += east.minutes.size() + west.minutes.size();
+	}
+    }
+    return departures;
+}
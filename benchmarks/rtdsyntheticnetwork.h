@@ -0,0 +1,85 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RTDSYNTHETICNETWORK_H
+#define RTDSYNTHETICNETWORK_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDate>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+#include "../rtdschedule.h"
+
+class RtdTimetableStore;
+
+// A made-up transit network of any size, for finding out how the engine
+// scales past RTD's few hundred routes: several agencies' worth of routes,
+// each running east and west through a chain of stations shared with its
+// neighbours, so that busy stations are served by many routes.
+//
+// Everything is derived from the sizes and the seed, so the same network can
+// be regenerated as route lists and schedule pages in RTD's own formats, for
+// the parser and rtdreplayserver, or as schedules filed straight into a store.
+class RtdSyntheticNetwork
+{
+    public:
+	RtdSyntheticNetwork(int routes, int stationsPerRoute, int tripsPerDay, uint seed = 1);
+
+	// the date all of the network's schedules are valid as of
+	static QDate validAsOf() { return QDate(2009, 8, 23); }
+
+	int routeCount() const { return m_routes; }
+	int stationCount() const { return m_stationPool; }
+	QString routeName(int route) const;
+	QString stationName(int station) const;
+
+	// the route's @p stop'th station, counting from its western end
+	int stationOf(int route, int stop) const;
+
+	// what a schedule page for @p route would parse to; @p day is a service
+	// type (1 Saturday, 2 Sunday/holiday, 3 weekday), @p direction 'E' or 'W'
+	RtdSchedule schedule(int route, int day, int direction) const;
+
+	// the same, in RTD's formats
+	QByteArray routeList() const;
+	QByteArray schedulePage(int route, int day, int direction) const;
+
+	// every route, day and direction; returns the number of departures filed
+	qint64 fillStore(RtdTimetableStore *store) const;
+
+    private:
+	// minutes into the service day at which @p trip leaves the route's first
+	// stop, and the minutes from there to each of its stops
+	int tripStart(int route, int day, int trip) const;
+	QVector<int> travelTimes(int route, int direction) const;
+	int tripCount(int day) const;
+	bool stopsAt(int trip, int stop) const;
+	QString subrouteOf(int route, int trip) const;
+	uint hash(uint a, uint b, uint c) const;
+
+	int m_routes;
+	int m_stationsPerRoute;
+	int m_tripsPerDay;
+	int m_stationPool;
+	uint m_seed;
+};
+
+#endif
@@ -18,28 +18,121 @@
  */
 
 #include "rtddenverengine.h"
+#include "rtdparsejob.h"
+#include "rtdroutelist.h"
 
+#include <KDE/KConfigGroup>
 #include <KDE/KJob>
+#include <KDE/KLocale>
+#include <KDE/KSharedConfig>
 #include <KDE/KStandardDirs>
-#include <KDE/KIO/Job>
-#include <KDE/KIO/TransferJob>
 
 #include <QtCore/QByteArray>
 #include <QtCore/QDataStream>
+#include <QtCore/QDir>
 #include <QtCore/QFile>
-#include <QtCore/QRegExp>
 #include <QtCore/QTime>
 
-#include <QtWebKit/QWebFrame>
-#include <QtWebKit/QWebPage>
+enum {
+    MAX_PARSE_THREADS = 2,
+    MAX_FETCHES = 4,
+    FAILED_RETRY_DELAY = 5*60*1000,
+    PREFETCH_DAYS = 2,
+    PREFETCH_DELAY = 60*1000,
+    PREFETCH_INTERVAL = 60*60*1000,
+    STORE_WRITE_DELAY = 5*1000,
+    NEXT_STOPS_CACHE_ENTRIES = 16,
+    NEXT_STOPS_CACHE_BYTES = 256*1024,
+    MAX_NEXT_STOPS_WAIT = 60*60*1000
+};
 
 RtdDenverEngine::RtdDenverEngine(QObject *parent, const QVariantList& args)
-    : Plasma::DataEngine(parent, args)
+    : Plasma::DataEngine(parent, args),
+      m_routeListJob(0),
+      m_nextStopsCache(NEXT_STOPS_CACHE_ENTRIES, NEXT_STOPS_CACHE_BYTES),
+      m_fetchScheduler(MAX_FETCHES),
+      m_warmTotal(0),
+      m_warmDone(0),
+      m_warmFailed(0),
+      m_storeWriteInFlight(false)
 {
+    qRegisterMetaType<RtdParseJob *>("RtdParseJob*");
+
+    KSharedConfigPtr config = KSharedConfig::openConfig(QLatin1String("plasma_engine_rtddenverrc"));
+    KConfigGroup cacheConfig(config, "Cache");
+    m_nextStopsCache.setLimits(cacheConfig.readEntry("NextStopsEntries", int(NEXT_STOPS_CACHE_ENTRIES)),
+			       cacheConfig.readEntry("NextStopsBytes", int(NEXT_STOPS_CACHE_BYTES)));
+    m_serveStale = cacheConfig.readEntry("ServeStale", true);
+    KConfigGroup networkConfig(config, "Network");
+    m_fetchScheduler.setMaxRunning(networkConfig.readEntry("MaxFetches", int(MAX_FETCHES)));
+    m_prefetch = networkConfig.readEntry("Prefetch", true);
+
+    // this can point at a local stand-in for RTD's web server
+    m_baseUrl = networkConfig.readEntry("BaseUrl", QString(QLatin1String("http://www3.rtd-denver.com/schedules/")));
+    if (!m_baseUrl.endsWith('/'))
+	m_baseUrl += '/';
+
+    // a Chrome trace-event file of the pipeline's stages, for chasing down latency
+    KConfigGroup debugConfig(config, "Debug");
+    QString traceFile = debugConfig.readEntry("TraceFile", QString());
+    if (!traceFile.isEmpty() && !m_tracer.open(traceFile))
+	kWarning() << "could not open the trace file" << traceFile;
+
+    m_cacheDir = KStandardDirs::locateLocal("data", QLatin1String("plasma_engine_rtddenver/"));
+    m_parsePool.setMaxThreadCount(MAX_PARSE_THREADS);
+
+    // all of the timetables live in one store; clean up after the old
+    // one-file-per-route cache the first time we create it
+    QString storePath = m_cacheDir + QLatin1String("timetables.dat");
+    if (!QFile::exists(storePath)) {
+	QDir cacheDir(m_cacheDir);
+	foreach (const QString& oldFile, cacheDir.entryList(QStringList(QLatin1String("Schedule-*.dat")), QDir::Files))
+	    cacheDir.remove(oldFile);
+    }
+    m_store = new RtdTimetableStore(storePath, &m_names);
+    m_fetchScheduler.loadValidators(m_cacheDir + QLatin1String("validators.dat"));
+
+    // whatever we cached last time is good enough to start with, if we're
+    // allowed to serve it before it's been rechecked
+    if (m_serveStale)
+	m_validAsOf = m_store->validAsOf();
+
+    // batch up writes of the store, since pages tend to arrive in bursts
+    m_storeTimer.setSingleShot(true);
+    m_storeTimer.setInterval(STORE_WRITE_DELAY);
+    connect(&m_storeTimer, SIGNAL(timeout()), this, SLOT(writeStore()));
+
+    // NextStops sources are pushed out when their first bus leaves, rather than polled
+    m_nextStopsTimer.setSingleShot(true);
+    connect(&m_nextStopsTimer, SIGNAL(timeout()), this, SLOT(updateNextStops()));
+    connect(this, SIGNAL(sourceRemoved(QString)), this, SLOT(forgetSource(QString)));
+
+    m_retryTimer.setSingleShot(true);
+    m_retryTimer.setInterval(FAILED_RETRY_DELAY);
+    connect(&m_retryTimer, SIGNAL(timeout()), this, SLOT(retryFailedSources()));
+
+    m_prefetchTimer.setSingleShot(true);
+    connect(&m_prefetchTimer, SIGNAL(timeout()), this, SLOT(prefetch()));
 }
 
 RtdDenverEngine::~RtdDenverEngine()
 {
+    // the parse and store-writing jobs point back at us
+    m_parsePool.waitForDone();
+
+    // abandon whatever is still on the network
+    for (QMap<KJob *, JobData>::const_iterator it = m_jobData.constBegin(); it != m_jobData.constEnd(); it++) {
+	delete it->parseJob;
+	delete it.key();
+    }
+    m_fetchScheduler.saveValidators(m_cacheDir + QLatin1String("validators.dat"));
+
+    if (m_store->isDirty() && m_validAsOf.isValid()) {
+	int epoch, generation;
+	RtdTimetableStore::write(m_store->fileName(), m_store->serialize(&epoch, &generation));
+    }
+    delete m_store;
+
     if (!m_routes.isEmpty())
 	saveRouteList();
 }
@@ -48,7 +141,8 @@ QStringList RtdDenverEngine::sources() const
 {
     QStringList ret;
 
-    ret << QLatin1String("Routes") << QLatin1String("ValidAsOf");
+    ret << QLatin1String("Routes") << QLatin1String("ValidAsOf") << QLatin1String("CacheStats")
+	<< QLatin1String("Stats");
 
     return ret;
 }
@@ -89,49 +183,48 @@ RtdDenverEngine::DayType RtdDenverEngine::dayType(TodayTomorrow tt) const
     if (tt == Tomorrow)
 	today = today.addDays(1);
 
-    if (today.dayOfWeek() == Qt::Saturday)
+    return dayTypeOf(today);
+}
+
+RtdDenverEngine::DayType RtdDenverEngine::dayTypeOf(const QDate& date)
+{
+    if (date.dayOfWeek() == Qt::Saturday)
 	return Saturday;
-    else if (today.dayOfWeek() == Qt::Sunday || isRtdHoliday(today))
+    else if (date.dayOfWeek() == Qt::Sunday || isRtdHoliday(date))
 	return SundayHoliday;
     else
 	return Weekday;
 }
 
-static int directionFromCode(const QString& directionCode)
-{
-    if (directionCode == QLatin1String("N"))
-	return 'N';
-    else if (directionCode == QLatin1String("S"))
-	return 'S';
-    else if (directionCode == QLatin1String("E"))
-	return 'E';
-    else if (directionCode == QLatin1String("W"))
-	return 'W';
-    else if (directionCode == QLatin1String("?"))
-	return '?';
-    else if (directionCode == QLatin1String("CW"))
-	return 'C';
-    else if (directionCode == QLatin1String("CCW"))
-	return 'c';
-    else if (directionCode == QLatin1String("Loop"))
-	return 'L';
-    return 0;
-}
-
 bool RtdDenverEngine::sourceRequestEvent(const QString& sourceName)
 {
     if (m_pendingRoutes.contains(sourceName))
         return true;
 
+    m_tracer.instant("request", sourceName);
+
+    // we're about to try again
+    if (m_failedSources.remove(sourceName))
+	removeData(sourceName, QLatin1String("Error"));
+
+    // "CacheStats": how well the NextStops cache is doing, so that it can be sized
+    if (sourceName == QLatin1String("CacheStats")) {
+	updateCacheStats();
+	return true;
+    }
+
+    // "Stats": counters and latency histograms of the engine's network fetches,
+    // parsing and lookups, for tuning; poll it to watch them change
+    if (sourceName == QLatin1String("Stats")) {
+	updateStats();
+	return true;
+    }
+
     if (m_routes.isEmpty() && !loadRouteList()) {
         // we need our route mapping before we can do anything else:
         // request a load of the route list and queue up this source
-        if (m_pendingRoutes.isEmpty()) {
-            KJob *fetchJob = fetchRouteList();
-            if (fetchJob) {
-                m_jobData.insert(fetchJob, JobData());
-            }
-        }
+        if (!m_routeListJob)
+            fetchRouteList(RtdFetchJob::UserPriority, false);
         m_pendingRoutes.insert(sourceName);
         setData(sourceName, Plasma::DataEngine::Data());
         return true;
@@ -140,9 +233,14 @@ bool RtdDenverEngine::sourceRequestEvent(const QString& sourceName)
     if (!schedulesValid()) {
         // we haven't loaded anything in the last day: do a network load to recheck
         // our schedule validity
-        checkValidity(sourceName);
-        setData(sourceName, Plasma::DataEngine::Data());
-        return true;
+        if (servingStale()) {
+            // but answer from the cache in the meantime
+            checkValidity(QString());
+        } else {
+            checkValidity(sourceName);
+            setData(sourceName, Plasma::DataEngine::Data());
+            return true;
+        }
     }
 
     // now handle the actual sources
@@ -154,6 +252,11 @@ bool RtdDenverEngine::sourceRequestEvent(const QString& sourceName)
         // "Routes": returns the list of route names
         setData(sourceName, routeList());
         return true;
+    } else if (sourceName == QLatin1String("WarmCache")) {
+        // "WarmCache": load the whole network into the cache, reporting the
+        // Total, Done and Failed loads and whether it is still Running
+        startWarmCache();
+        return true;
     }  else if (sourceName.startsWith("DirectionOf ")) {
         // "DirectionOf routeName": returns the direction code for the
         // direction(s) of the route @p routeName, i.e. "N", "S", "E", "W", "Loop", "CW",
@@ -182,18 +285,27 @@ bool RtdDenverEngine::sourceRequestEvent(const QString& sourceName)
         // is the subroute of that bus or train (e.g. B, BF, or BX). Note that the list
         // is sorted by arrival time, so stops storted with A.M. times after stops with
         // P.M. times are actually arriving on the next day.
-        bool textForm = sourceName.endsWith(QLatin1String(" TEXT"));
-        QString fullRouteName = sourceName.mid(11, sourceName.length() - (textForm ? 11+5 : 11));
+        const RtdQuery *query = queryFor(sourceName);
+        if (query->kind == RtdQuery::Invalid)
+            return true;
 
         // try to load the schedule from cache
-        Plasma::DataEngine::Data stops = loadSchedule(fullRouteName, dayType(Today));
+        Plasma::DataEngine::Data stops;
+        {
+            RtdHistogramTimer timer(&m_stats.loadTime);
+            stops = loadSchedule(query->stops.first(), dayType(Today));
+        }
 
         // no cached data: go to the network
-        if (stops.isEmpty())
-            return setupScheduleFetch(sourceName, fullRouteName, dayType(Today));
+        if (stops.isEmpty()) {
+            if (setupScheduleFetch(sourceName, query->stops.first().fullRouteName, dayType(Today)))
+                return true;
+            m_queries.remove(sourceName);
+            return false;
+        }
 
         // convert to a textual representation if requested
-        if (textForm) {
+        if (query->textForm) {
             for (Plasma::DataEngine::Data::iterator it = stops.begin(); it != stops.end(); it++) {
                 QStringList stringified;
                 QList<TimeRoutePair> trp = it.value().value< QList<TimeRoutePair> >();
@@ -204,7 +316,12 @@ bool RtdDenverEngine::sourceRequestEvent(const QString& sourceName)
         }
 
         setData(sourceName, stops);
+        schedulePrefetch();
         return true;
+    } else if (sourceName.startsWith("NextStops [")) {
+        // a list of stops that doesn't make sense says so once, and then stays quiet
+        if (queryFor(sourceName)->kind == RtdQuery::Invalid)
+            return true;
     }
 
     return updateSourceEvent(sourceName);
@@ -217,88 +334,268 @@ bool RtdDenverEngine::updateSourceEvent(const QString& sourceName)
     if (m_pendingRoutes.contains(sourceName))
         return false;   // nothing new yet
 
+    if (sourceName == QLatin1String("CacheStats")) {
+	updateCacheStats();
+	return true;
+    }
+
+    if (sourceName == QLatin1String("Stats")) {
+	updateStats();
+	return true;
+    }
+
+    if (sourceName == QLatin1String("WarmCache")) {
+	updateWarmCache();
+	return true;
+    }
+
     // before we try to load things from cache, we need to know our cache validity
     if (!schedulesValid()) {
 	// we haven't loaded anything in the last day: do a network load to recheck
 	// our schedule validity
-	checkValidity(sourceName);
-	return false;   // nothing new yet
+	if (servingStale()) {
+	    // but answer from the cache in the meantime
+	    checkValidity(QString());
+	} else {
+	    checkValidity(sourceName);
+	    return false;   // nothing new yet
+	}
     }
 
     if (sourceName.startsWith("NextStops [")) {
 	// "NextStops [routeName1-direction1:stopName1,routeName2-direction2:stopName2,...] N TEXT?": 
-	// request a list of upcoming buses at a give set of routes and stops
-
-	// find the list of routes and stops
-	int lastBracket = sourceName.indexOf(']');
-	if (lastBracket < 0)
+	// request a list of upcoming buses at a give set of routes and stops. The
+	// "NextChange" key says when the list will next change; the source is
+	// updated then without needing to be polled
+	QDateTime now = QDateTime::currentDateTime();
+
+	// the list of routes and stops, and what to make of them
+	RtdQuery *query = queryFor(sourceName);
+	if (query->kind == RtdQuery::Invalid)
 	    return false;
-	QString routeList = sourceName.mid(11, lastBracket - 11);
-//	kDebug() << "NextStops: routeList =" << routeList;
 
-	// parse the rest of the parameters
-	QStringList nAndText = sourceName.mid(lastBracket + 2).split(' ');
-	if (nAndText.isEmpty())
-	    return false;
-
-	bool textForm = (nAndText.length() == 2 && nAndText.last() == QLatin1String("TEXT"));
-	int n = nAndText.first().toInt();
+	// the usual case: someone is already following these stops, and a bus
+	// left, so just step past it
+	QHash<QString, NextStopsStream>::iterator stream = m_nextStopsStreams.find(query->stopSet);
+	QSet<QString> followers;
+	if (stream != m_nextStopsStreams.end()) {
+	    if (stream->cursor.isCurrent(now.date(), m_validAsOf)) {
+		stream->sources.insert(sourceName);
+		publishNextStops(*stream, QStringList(sourceName), now);
+		scheduleNextStopsUpdate();
+		return true;
+	    }
 
-	if (n <= 0)
-	    return false;
+	    // its day has ended, or the schedules changed: start it over
+	    followers = stream->sources;
+	    followers.remove(sourceName);
+	    m_nextStopsStreams.erase(stream);
+	}
 
+	NextStopsStream fresh;
 	bool ok;
-	QList<DateTimeRoutePair> stops = stopsForCurrentDateTime(sourceName, routeList.split(','), n, &ok);
+	qint64 start = rtdMonotonicMicros();
+	bool built = setupNextStopsCursor(sourceName, query, now, &fresh.cursor, &ok);
+	if (built) {
+	    m_stats.nextStopsTime.record(rtdMonotonicMicros() - start);
+	    fresh.sources.insert(sourceName);
+	    publishNextStops(m_nextStopsStreams.insert(query->stopSet, fresh).value(), QStringList(sourceName), now);
+	} else if (ok) {
+	    // we had to kick off some network loads
+	    setData(sourceName, Plasma::DataEngine::Data());
+	} else {
+	    m_queries.remove(sourceName);
+	}
+
+	// whoever else was following the old stream joins the new one, or
+	// waits on the network along with us
+	foreach (const QString& follower, followers)
+	    updateSourceEvent(follower);
 
-	if (stops.isEmpty()) {
-	    // maybe we had to kick off some network loads
-            if (ok)
-                setData(sourceName, Plasma::DataEngine::Data());
+	if (!built)
 	    return ok;
-	}
 
-	if (textForm) {
-	    QStringList ret;
-	    foreach (const DateTimeRoutePair& tr, stops) {
-		QString s = tr.second + QLatin1String(" - ") + tr.first.toString(QLatin1String("H:mm' 'AP"));
-		if (tr.first.date() != QDate::currentDate())
-		    s += QLatin1String(" [tomorrow]");
-		ret << s;
-	    }
-	    setData(sourceName, ret);
-	    return true;
-	}
-	setData(sourceName, qVariantFromValue(stops));
+	scheduleNextStopsUpdate();
+	schedulePrefetch();
 	return true;
     }
 
     return false;
 }
 
-void RtdDenverEngine::dataReceived(KIO::Job *job, const QByteArray& data)
+// hand the next departures of one stop set to @p sourceNames: the stream is
+// walked and its departures formatted once, and each source gets its share
+void RtdDenverEngine::publishNextStops(NextStopsStream& stream, const QStringList& sourceNames, const QDateTime& now)
+{
+    int n = 0;
+    bool textForm = false;
+    foreach (const QString& sourceName, sourceNames) {
+	QHash<QString, RtdQuery>::const_iterator query = m_queries.constFind(sourceName);
+	if (query == m_queries.constEnd())
+	    continue;
+	n = qMax(n, query->n);
+	textForm = textForm || query->textForm;
+    }
+
+    // nobody left to publish to
+    if (n == 0)
+	return;
+
+    QList<DateTimeRoutePair> stops = stream.cursor.next(now, n, m_names);
+    QDateTime nextChange = stream.cursor.nextChange();
+
+    QStringList text;
+    if (textForm) {
+	foreach (const DateTimeRoutePair& tr, stops) {
+	    QString s = tr.second + QLatin1String(" - ") + tr.first.toString(QLatin1String("H:mm' 'AP"));
+	    if (tr.first.date() != now.date())
+		s += QLatin1String(" [tomorrow]");
+	    text << s;
+	}
+    }
+
+    foreach (const QString& sourceName, sourceNames) {
+	// a source that has been removed gets nothing
+	QHash<QString, RtdQuery>::const_iterator query = m_queries.constFind(sourceName);
+	if (query == m_queries.constEnd())
+	    continue;
+
+	if (stops.isEmpty())
+	    setData(sourceName, Plasma::DataEngine::Data());
+	else if (query->textForm)
+	    setData(sourceName, text.mid(0, query->n));
+	else
+	    setData(sourceName, qVariantFromValue(stops.mid(0, query->n)));
+	setData(sourceName, QLatin1String("NextChange"), nextChange);
+    }
+}
+
+// the compiled form of a NextStops or ScheduleOf source, compiling it the first
+// time round; a name that doesn't make sense gets its error published then
+RtdQuery *RtdDenverEngine::queryFor(const QString& sourceName)
+{
+    QHash<QString, RtdQuery>::iterator it = m_queries.find(sourceName);
+    if (it == m_queries.end()) {
+	it = m_queries.insert(sourceName, RtdQuery::compile(sourceName));
+	if (it->kind == RtdQuery::Invalid) {
+	    kDebug() << "bad source name" << sourceName << it->error;
+	    setData(sourceName, QLatin1String("Error"), it->error);
+	}
+    }
+
+    return &it.value();
+}
+
+void RtdDenverEngine::forgetSource(const QString& sourceName)
+{
+    // a stream lasts as long as somebody is following it
+    QHash<QString, RtdQuery>::iterator query = m_queries.find(sourceName);
+    if (query != m_queries.end()) {
+	QHash<QString, NextStopsStream>::iterator stream = m_nextStopsStreams.find(query->stopSet);
+	if (stream != m_nextStopsStreams.end() && stream->sources.remove(sourceName) && stream->sources.isEmpty())
+	    m_nextStopsStreams.erase(stream);
+	m_queries.erase(query);
+    }
+
+    m_failedSources.remove(sourceName);
+}
+
+void RtdDenverEngine::scheduleNextStopsUpdate()
 {
-    m_jobData[job].networkData += data;
+    if (m_nextStopsStreams.isEmpty()) {
+	m_nextStopsTimer.stop();
+	return;
+    }
+
+    QDateTime first;
+    for (QHash<QString, NextStopsStream>::const_iterator it = m_nextStopsStreams.constBegin();
+	 it != m_nextStopsStreams.constEnd(); it++) {
+	QDateTime nextChange = it->cursor.nextChange();
+	if (!first.isValid() || nextChange < first)
+	    first = nextChange;
+    }
+
+    // don't sleep too long at a stretch, in case the clock gets changed under us
+    QDateTime now = QDateTime::currentDateTime();
+    qint64 wait = qint64(now.date().daysTo(first.date())) * 24*60*60*1000 + now.time().msecsTo(first.time());
+    m_nextStopsTimer.start(int(qBound(qint64(0), wait, qint64(MAX_NEXT_STOPS_WAIT))));
+}
+
+void RtdDenverEngine::updateNextStops()
+{
+    QDateTime now = QDateTime::currentDateTime();
+
+    QStringList due;
+    for (QHash<QString, NextStopsStream>::const_iterator it = m_nextStopsStreams.constBegin();
+	 it != m_nextStopsStreams.constEnd(); it++) {
+	if (it->cursor.nextChange() <= now)
+	    due << it.key();
+    }
+
+    foreach (const QString& stopSet, due) {
+	QHash<QString, NextStopsStream>::iterator stream = m_nextStopsStreams.find(stopSet);
+	if (stream == m_nextStopsStreams.end() || stream->sources.isEmpty())
+	    continue;
+
+	// a stream whose day has ended gets rebuilt by way of one of its
+	// sources, which may mean waiting on the network; its sources rejoin
+	// the schedule once they have data again
+	if (stream->cursor.isCurrent(now.date(), m_validAsOf))
+	    publishNextStops(*stream, stream->sources.toList(), now);
+	else
+	    updateSourceEvent(*stream->sources.constBegin());
+    }
+
+    scheduleNextStopsUpdate();
 }
 
 void RtdDenverEngine::routeListResult(KJob *job)
 {
-    JobData jd = m_jobData.take(job);
+    recordFetch(job);
+    traceFetchEnd("route list fetch", job, m_pendingRoutes);
+    m_jobData.remove(job);
+    m_routeListJob = 0;
+
+    if (job->error()) {
+	// everyone who was waiting on the route list is stuck
+	foreach (const QString& sourceName, m_pendingRoutes)
+	    failSource(sourceName, job->errorString());
+	m_pendingRoutes.clear();
+	return;
+    }
 
-    if (job->error())
+    // the list we have is still current
+    if (static_cast<RtdFetchJob *>(job)->isNotModified() && !m_routes.isEmpty())
 	return;
 
-    QHash<QString, QString> routes = parseRouteList(jd.networkData);
+    QHash<QString, QString> routes = parseRtdRouteList(static_cast<RtdFetchJob *>(job)->data());
+    if (routes.isEmpty()) {
+	// keep whatever list we had, but don't leave anyone waiting on it
+	foreach (const QString& sourceName, m_pendingRoutes)
+	    failSource(sourceName, i18n("Could not understand the route list from RTD"));
+	m_pendingRoutes.clear();
+	return;
+    }
 
-    for (QHash<QString, QString>::const_iterator it = routes.constBegin(); it != routes.constEnd(); it++)
-	m_routes.insert(it.key(), RouteData(it.value()));
+    // hang on to the directions we've already learned
+    QHash<QString, RouteData> oldRoutes = m_routes;
+    m_routes.clear();
+    for (QHash<QString, QString>::const_iterator it = routes.constBegin(); it != routes.constEnd(); it++) {
+	RouteData route(it.value());
+	if (oldRoutes.contains(it.key()) && oldRoutes[it.key()].key == route.key)
+	    route.directions = oldRoutes[it.key()].directions;
+	m_routes.insert(it.key(), route);
+    }
 
     // we've got data
     setData(QLatin1String("Routes"), routeList());
 
-    // tell the sources that were waiting for the route list to retry
-    foreach (const QString& sourceName, m_pendingRoutes)
-	updateSourceEvent(sourceName);
+    // the sources that were waiting for the route list never got set
+    // up, so start them over from the beginning
+    QSet<QString> pending = m_pendingRoutes;
     m_pendingRoutes.clear();
+    foreach (const QString& sourceName, pending)
+	sourceRequestEvent(sourceName);
 }
 
 void RtdDenverEngine::maybeRetrySource(const QString& sourceName, KJob *completedJob)
@@ -309,66 +606,208 @@ void RtdDenverEngine::maybeRetrySource(const QString& sourceName, KJob *complete
     // if this source is not waiting on anything else, retry it
     if (m_pendingSchedules[sourceName].isEmpty()) {
 	m_pendingSchedules.remove(sourceName);
+	qint64 start = rtdMonotonicMicros();
+	sourceRequestEvent(sourceName);
+	m_tracer.span("retry", completedJob, start, rtdMonotonicMicros(), sourceName);
+    }
+}
+
+// give up on a source: stop it waiting on any other loads and tell whoever is
+// watching it what went wrong
+void RtdDenverEngine::failSource(const QString& sourceName, const QString& error)
+{
+    QSet<KJob *> jobs = m_pendingSchedules.take(sourceName);
+    foreach (KJob *job, jobs) {
+	QMap<KJob *, JobData>::iterator it = m_jobData.find(job);
+	if (it != m_jobData.end())
+	    it->pendingSources.remove(sourceName);
+    }
+
+    m_tracer.instant("fail", sourceName, error);
+    m_failedSources.insert(sourceName);
+    setData(sourceName, QLatin1String("Error"), error);
+    if (!m_retryTimer.isActive())
+	m_retryTimer.start();
+}
+
+void RtdDenverEngine::retryFailedSources()
+{
+    foreach (const QString& sourceName, m_failedSources)
 	sourceRequestEvent(sourceName);
+}
+
+// parse schedule pages as they come in, so that most of the work is done by
+// the time the last of the page arrives
+void RtdDenverEngine::schedulePageData(RtdFetchJob *job, const QByteArray& data)
+{
+    RtdParseJob *parseJob = parseJobFor(job);
+    if (parseJob)
+	parseJob->addData(data);
+}
+
+void RtdDenverEngine::schedulePageRestarted(RtdFetchJob *job)
+{
+    QMap<KJob *, JobData>::iterator it = m_jobData.find(job);
+    if (it != m_jobData.end() && it->parseJob)
+	it->parseJob->restart();
+}
+
+RtdParseJob *RtdDenverEngine::parseJobFor(KJob *job)
+{
+    QMap<KJob *, JobData>::iterator it = m_jobData.find(job);
+    if (it == m_jobData.end())
+	return 0;
+
+    if (!it->parseJob) {
+	it->parseJob = new RtdParseJob(this, &m_parsePool, job, it->routeName, it->direction, m_validAsOf);
+	connect(it->parseJob, SIGNAL(parsed(RtdParseJob*)),
+		this, SLOT(scheduleParsed(RtdParseJob*)), Qt::QueuedConnection);
     }
+    return it->parseJob;
 }
 
 void RtdDenverEngine::schedulePageResult(KJob *job)
 {
-    JobData jd = m_jobData.take(job);
+    recordFetch(job);
+    traceFetchEnd("schedule download", job, m_jobData.value(job).pendingSources);
+    if (job->error()) {
+	JobData jd = takeScheduleJob(job);
+	job->deleteLater();
+	if (jd.parseJob)
+	    jd.parseJob->abandon();
+	foreach (const QString& sourceName, jd.pendingSources)
+	    failSource(sourceName, job->errorString());
+	warmJobFinished(job, jd, false);
+	return;
+    }
 
-    if (job->error())
+    // the page is the one we already have, so our schedules are still current
+    if (static_cast<RtdFetchJob *>(job)->isNotModified()) {
+	JobData jd = takeScheduleJob(job);
+	job->deleteLater();
+	if (jd.parseJob)
+	    jd.parseJob->abandon();
+
+	m_validCheckedDate = QDate::currentDate();
+	if (!m_validAsOf.isValid()) {
+	    m_validAsOf = m_store->validAsOf();
+	    setData(QLatin1String("ValidAsOf"), m_validAsOf);
+	}
+
+	foreach (const QString& sourceName, jd.pendingSources)
+	    maybeRetrySource(sourceName, job);
+	warmJobFinished(job, jd, true);
 	return;
+    }
 
-    // parse the downloaded schedule
-    QVariantMap scheduleData = parseSchedule(jd.networkData);
-    QDate validAsOf;
+    // let the worker finish off the page; the job stays in m_jobData until
+    // then, so other sources can still join it
+    RtdParseJob *parseJob = parseJobFor(job);
+    if (parseJob)
+	parseJob->finish();
+}
 
-    if (scheduleData.isEmpty())
+void RtdDenverEngine::scheduleParsed(RtdParseJob *parseJob)
+{
+    // its download failed, and we've already dealt with that
+    if (parseJob->isAbandoned()) {
+	parseJob->deleteLater();
 	return;
+    }
+
+    m_stats.parseTime.record(parseJob->parseTime());
+    KJob *job = parseJob->job();
+    const RtdSchedulePage& page = parseJob->page();
+    JobData jd = takeScheduleJob(job);
+    if (m_tracer.isEnabled()) {
+	m_tracer.span("parse", job, parseJob->parseStarted(), parseJob->parseFinished(),
+		      QStringList(jd.pendingSources.toList()).join(QLatin1String(", ")),
+		      QString(QLatin1String("%1 us on the workers")).arg(parseJob->parseTime()));
+    }
+    job->deleteLater();
+    parseJob->deleteLater();
 
-    // if the route doesn't exist on this day, save an empty result
-    if (scheduleData["notFound"].toInt())
-        goto doSave;
+    if (page.status == RtdSchedulePage::Unreadable) {
+	foreach (const QString& sourceName, jd.pendingSources)
+	    failSource(sourceName, i18n("Could not understand the schedule from RTD"));
+	warmJobFinished(job, jd, false);
+	return;
+    }
 
-    // store the parsed data:
-    // first check the schedule's temporal validity
-    m_validCheckedDate = QDate::currentDate();
-    validAsOf = QDate::fromString(scheduleData["validAsOf"].toString(), QLatin1String("MMMM d, yyyy"));
-    if (validAsOf.isValid()) {
-	// we've got a known validity: if it's new, refresh everything
+    // if the route doesn't exist on this day, there's nothing more to learn
+    if (page.status == RtdSchedulePage::Found) {
+	// first check the schedule's temporal validity: if it's new, refresh everything
+	m_validCheckedDate = QDate::currentDate();
 	QDate oldValidAsOf = m_validAsOf;
-	m_validAsOf = validAsOf;
-	if (oldValidAsOf.isValid() && oldValidAsOf != validAsOf) {
+	m_validAsOf = page.validAsOf;
+	if (m_store->setValidAsOf(m_validAsOf)) {
+	    // nothing refers to the old schedules' names any more: start the
+	    // intern table over, so that it and the store file don't keep every
+	    // name they ever saw (the NextStops streams of the old schedules get
+	    // rebuilt before they're next published)
+	    m_names.clear();
+	    m_nextStopsCache.clear();
+	    for (QHash<QString, RtdQuery>::iterator it = m_queries.begin(); it != m_queries.end(); it++)
+		it->unresolve();
+	}
+	if (oldValidAsOf.isValid() && oldValidAsOf != m_validAsOf) {
+	    m_nextStopsCache.clear();
 	    setData("ValidAsOf", m_validAsOf);
 	    updateAllSources();
+
+	    // new schedules may come with new routes
+	    if (!m_routeListJob && !m_routes.isEmpty())
+		fetchRouteList(RtdFetchJob::ValidityPriority, true);
 	} else if (!oldValidAsOf.isValid()) {
 	    setData("ValidAsOf", m_validAsOf);
 	}
-    }
 
-//    kDebug() << "availableDirections:" << scheduleData[QLatin1String("availableDirections")].toString()
-//	  << "direction:" << scheduleData[QLatin1String("direction")].toString();
-
-    // then record the direction of this route
-    if (!jd.routeName.isEmpty() && m_routes[jd.routeName].directions.isEmpty()) {
-	QString directions = scheduleData[QLatin1String("availableDirections")].toString();
-	m_routes[jd.routeName].directions = directions;
+	// then record the direction of this route
+	if (!jd.routeName.isEmpty() && m_routes[jd.routeName].directions.isEmpty())
+	    m_routes[jd.routeName].directions = page.availableDirections;
     }
 
-    // finally save the schedules
-doSave:
-    if (!jd.routeName.isEmpty()) {
-      QString directionCode = scheduleData[QLatin1String("direction")].toString();
-      int direction = (directionCode.isEmpty() ? jd.direction : directionFromCode(directionCode));
-
-      if (direction != '?')
-	  saveSchedule(jd.routeName, jd.routeDay, direction, scheduleData["schedules"].toMap());
+    // file the timetable, unless it's from some other set of schedules
+    if (parseJob->hasTimetable() && parseJob->validAsOf() == m_store->validAsOf()) {
+	m_store->insert(jd.routeName, jd.routeDay, parseJob->direction(), parseJob->timetable());
+	if (!m_storeTimer.isActive())
+	    m_storeTimer.start();
     }
 
     // let each source that is waiting for us know that we're done
     foreach (const QString& sourceName, jd.pendingSources)
 	maybeRetrySource(sourceName, job);
+    warmJobFinished(job, jd, true);
+}
+
+void RtdDenverEngine::writeStore()
+{
+    // a cache warm-up writes everything once it's done
+    if (m_storeWriteInFlight || !m_store->isDirty() || !m_validAsOf.isValid() || !m_warmJobs.isEmpty())
+	return;
+
+    int epoch, generation;
+    QByteArray image = m_store->serialize(&epoch, &generation);
+
+    m_storeWriteInFlight = true;
+    m_tracer.begin("store write", m_store);
+    m_parsePool.start(new RtdTimetableStoreWriter(m_store->fileName(), image, epoch, generation,
+						  this, "storeWritten"));
+}
+
+void RtdDenverEngine::storeWritten(int epoch, int generation, bool ok)
+{
+    m_storeWriteInFlight = false;
+    m_tracer.end("store write", m_store, QString(), ok ? QString() : QString(QLatin1String("failed")));
+
+    if (ok)
+	m_store->adopt(epoch, generation);
+    else
+	kWarning() << "could not write the timetable store" << m_store->fileName();
+
+    // more schedules may have come in while we were writing
+    if (m_store->isDirty() && !m_storeTimer.isActive())
+	m_storeTimer.start();
 }
 
 // request a schedule from the network or join a pending fetch of the same schedule, as needed
@@ -386,263 +825,313 @@ bool RtdDenverEngine::setupScheduleFetch(const QString& sourceName, const QStrin
 	return false;
 
     // see if there's already a pending network load for this job
-    for (QMap<KJob *, JobData>::iterator it = m_jobData.begin(); it != m_jobData.end(); it++) {
-	if (it.value().routeName == routeName && it.value().routeDay == day &&
-	    it.value().direction == direction) {
-	    // there is: add us to its queue and note that we're waiting on it
-	    // (if we aren't already...)
-	    if (it.value().pendingSources.contains(sourceName))
-		return true;
-
-	    it.value().pendingSources.insert(sourceName);
-	    m_pendingSchedules[sourceName].insert(it.key());
+    KJob *pendingJob = m_scheduleJobs.value(FetchKey(routeName, day, direction));
+    if (pendingJob) {
+	// there is: add us to its queue and note that we're waiting on it
+	// (if we aren't already...)
+	JobData& jd = m_jobData[pendingJob];
+	if (jd.pendingSources.contains(sourceName))
 	    return true;
-	}
+
+	static_cast<RtdFetchJob *>(pendingJob)->raisePriority(RtdFetchJob::UserPriority);
+	jd.pendingSources.insert(sourceName);
+	m_pendingSchedules[sourceName].insert(pendingJob);
+	m_stats.fetchesCoalesced++;
+	m_tracer.instant("join", sourceName, RtdTracer::idString(pendingJob));
+	return true;
     }
 
     // no pending load: set one up
-    KJob *fetchJob = fetchSchedule(keyForRoute(routeName), day, direction);
+    KJob *fetchJob = fetchSchedule(keyForRoute(routeName), day, direction, RtdFetchJob::UserPriority, false);
     if (!fetchJob)
 	return false;
 
     // store the parameters of this job and note that this source is waiting on it
-    m_jobData.insert(fetchJob, JobData(sourceName, routeName, day, direction));
+    addScheduleJob(fetchJob, JobData(sourceName, routeName, day, direction));
     m_pendingSchedules[sourceName].insert(fetchJob);
+    m_tracer.instant("join", sourceName, RtdTracer::idString(fetchJob));
 //    kDebug() << "load for " << sourceName << "is " << fetchJob;
     return true;
 }
 
-// do a direct network load to check our cache validity timestamp
+// do a direct network load to check our cache validity timestamp; with no
+// @p sourceName, nobody waits for the answer
 void RtdDenverEngine::checkValidity(const QString& sourceName)
 {
     // if there's already a pending network load of a schedule page, we can
     // piggy-back off of it
-    for (QMap<KJob *, JobData>::iterator it = m_jobData.begin(); it != m_jobData.end(); it++) {
-	if (!it.value().routeName.isEmpty()) {
-	    it.value().pendingSources.insert(sourceName);
-	    m_pendingSchedules[sourceName].insert(it.key());
-	    return;
+    if (!m_scheduleJobs.isEmpty()) {
+	KJob *pendingJob = m_scheduleJobs.constBegin().value();
+	static_cast<RtdFetchJob *>(pendingJob)->raisePriority(RtdFetchJob::ValidityPriority);
+	m_stats.validityPiggybacks++;
+	if (!sourceName.isEmpty() && !m_jobData[pendingJob].pendingSources.contains(sourceName)) {
+	    m_jobData[pendingJob].pendingSources.insert(sourceName);
+	    m_pendingSchedules[sourceName].insert(pendingJob);
+	    m_stats.fetchesCoalesced++;
 	}
+	m_tracer.instant("validity check", sourceName, RtdTracer::idString(pendingJob));
+	return;
     }
 
     // if there's no network load going, we have to kick one off
     // since we may not nave the route list yet, we have to fully specify the load
     // ourselves -- the B/BF/BX route (Denver-Boulder) is unlikely to ever be canceled,
     // so we'll use it by default
-    KJob *fetchJob = fetchSchedule(QLatin1String("routeId=B"), Weekday, 'W');
+    // if we have that page already, the server only needs to tell us it hasn't changed
+    bool haveRoute = m_store->route(QLatin1String("B/BF/BX"), Weekday, 'W').isValid();
+    KJob *fetchJob = fetchSchedule(QLatin1String("routeId=B"), Weekday, 'W', RtdFetchJob::ValidityPriority, haveRoute);
     if (!fetchJob)
 	return;
+    m_tracer.instant("validity check", sourceName, RtdTracer::idString(fetchJob));
 
-    m_jobData.insert(fetchJob, JobData(sourceName, "B/BF/BX", Weekday, 'W'));
-    m_pendingSchedules[sourceName].insert(fetchJob);
+    if (sourceName.isEmpty()) {
+	addScheduleJob(fetchJob, JobData("B/BF/BX", Weekday, 'W'));
+    } else {
+	addScheduleJob(fetchJob, JobData(sourceName, "B/BF/BX", Weekday, 'W'));
+	m_pendingSchedules[sourceName].insert(fetchJob);
+    }
 }
 
-// actually perform a network fetch of a schedule for a given route, day, and direction
-// direction == 0 means no direction specified
-KJob *RtdDenverEngine::fetchSchedule(const QString& query, DayType day, int direction)
+void RtdDenverEngine::schedulePrefetch()
 {
-    QString scheduleUrl = QLatin1String("http://www3.rtd-denver.com/schedules/getSchedule.action?");
-    scheduleUrl += query;
-    scheduleUrl += QString(QLatin1String("&serviceType=%1")).arg(int(day));
+    if (m_prefetch && !m_prefetchTimer.isActive())
+	m_prefetchTimer.start(PREFETCH_DELAY);
+}
 
-    if (direction) {
-	switch (direction) {
-	case 'N':
-	case 'S':
-	case 'E':
-	case 'W':
-	    scheduleUrl += QString(QLatin1String("&direction=%1-Bound")).arg(QChar(direction));
-	    break;
-	case 'C':
-	    scheduleUrl += QLatin1String("&direction=Clock");
-	    break;
-	case 'c':
-	    scheduleUrl += QLatin1String("&direction=Counterclock");
-	    break;
-	case 'L':
-	case '?':
-	    break;
-	default:
-	    kWarning() << "Unknown direction " << QChar(direction);
-	    return 0;
-	}
-    }
+// the full route names (e.g. "B/BF/BX-E") that a source is watching
+QStringList RtdDenverEngine::routesOfSource(const QString& sourceName) const
+{
+    QStringList routes;
 
-    KJob *fetchJob = KIO::get(KUrl(scheduleUrl), KIO::NoReload, KIO::HideProgressInfo);
-    connect(fetchJob, SIGNAL(data(KIO::Job*,QByteArray)), this, SLOT(dataReceived(KIO::Job*,QByteArray)));
-    connect(fetchJob, SIGNAL(result(KJob*)), this, SLOT(schedulePageResult(KJob*)));
+    QHash<QString, RtdQuery>::const_iterator it = m_queries.constFind(sourceName);
+    if (it != m_queries.constEnd()) {
+	foreach (const RtdQuery::Stop& stop, it->stops)
+	    routes << stop.fullRouteName;
+    }
 
-    return fetchJob;
+    return routes;
 }
 
-// fetch the route list from RTD, using the JavaScript data structure they
-// use to back up the schedule menu on their website
-KJob *RtdDenverEngine::fetchRouteList()
+// fetch the schedules that the sources we have will want over the next few
+// days, so that the change of day never has to wait on the network
+void RtdDenverEngine::prefetch()
 {
-    KUrl routeListUrl(QLatin1String("http://www3.rtd-denver.com/schedules/ajax/getAjaxRouteMenu.action"));
-
-    KJob *fetchJob = KIO::get(routeListUrl, KIO::NoReload, KIO::HideProgressInfo);
-    connect(fetchJob, SIGNAL(data(KIO::Job*,QByteArray)), this, SLOT(dataReceived(KIO::Job*,QByteArray)));
-    connect(fetchJob, SIGNAL(result(KJob*)), this, SLOT(routeListResult(KJob*)));
+    if (!m_validAsOf.isValid() || m_store->validAsOf() != m_validAsOf)
+	return;
 
-    return fetchJob;
-}
+    // only when things are quiet
+    if (m_fetchScheduler.running() > 0 || m_fetchScheduler.queued() > 0) {
+	m_prefetchTimer.start(PREFETCH_DELAY);
+	return;
+    }
 
-static QString dumpJsObj(const QVariant& obj, QString indent = QString());
-static QString dumpJsArray(const QVariant& array, QString indent = QString());
-
-static QString dumpJsArray(const QVariant& array, QString indent)
-{
-    QString ret;
-    QVariantList list = array.toList();
-
-    for (int i = 0; i < list.length(); i++) {
-	QVariant val = list[i];
-	ret += indent;
-	switch (val.type()) {
-	case QVariant::Map:
-	  ret += "{\n" + dumpJsObj(val, indent + "  ");
-	  ret += indent + '}';
-	  break;
-	case QVariant::List:
-	  ret += "[\n" + dumpJsArray(val, indent + "  ");
-	  ret += indent + ']';
-	  break;
-	case QVariant::Int:
-	case QVariant::Double:
-	  ret += val.toString();
-	  break;
-	default:
-	  ret += '"' + val.toString() + '"';
-	  break;
-	}
+    QSet<QString> routes;
+    foreach (const QString& sourceName, containerDict().keys())
+	routes += routesOfSource(sourceName).toSet();
+    if (routes.isEmpty())
+	return;
 
-	if (i < list.length() - 1)
-	  ret += ',';
+    QList<DayType> days;
+    QDate today = QDate::currentDate();
+    for (int i = 1; i <= PREFETCH_DAYS; i++) {
+	DayType day = dayTypeOf(today.addDays(i));
+	if (!days.contains(day))
+	    days << day;
+    }
 
-	ret += '\n';
+    foreach (const QString& fullRouteName, routes) {
+	foreach (DayType day, days)
+	    prefetchSchedule(fullRouteName, day);
     }
 
-    return ret;
+    // come back later: tomorrow will be today soon enough
+    m_prefetchTimer.start(PREFETCH_INTERVAL);
 }
 
-static QString dumpJsObj(const QVariant& obj, QString indent)
-{
-    QString ret;
-    QVariantMap map = obj.toMap();
-    QStringList keys = map.keys();
-
-    for (int i = 0; i < keys.length(); i++) {
-	ret += indent + keys[i] + ": ";
-	QVariant val = map[keys[i]];
-	switch (val.type()) {
-	case QVariant::Map:
-	  ret += "{\n" + dumpJsObj(val, indent + "  ");
-	  ret += indent + '}';
-	  break;
-	case QVariant::List:
-	  ret += "[\n" + dumpJsArray(val, indent + "  ");
-	  ret += indent + ']';
-	  break;
-	case QVariant::Int:
-	case QVariant::Double:
-	  ret += val.toString();
-	  break;
-	default:
-	  ret += '"' + val.toString() + '"';
-	  break;
-	}
+// start a background load of a schedule we don't have yet, returning the job
+// that is fetching it (which may already have been on its way)
+KJob *RtdDenverEngine::prefetchSchedule(const QString& fullRouteName, DayType day)
+{
+    int hyphenPos = fullRouteName.indexOf('-');
+    if (hyphenPos < 0)
+	return 0;
 
-	if (i < keys.length() - 1)
-	  ret += ',';
+    QString routeName = fullRouteName.left(hyphenPos);
+    int direction = directionFromCode(fullRouteName.mid(hyphenPos + 1));
+    if (!m_routes.contains(routeName) || !direction)
+	return 0;
+
+    // nothing to do if we have it, or it's on its way
+    if (m_store->route(routeName, day, direction).isValid())
+	return 0;
+    KJob *pendingJob = m_scheduleJobs.value(FetchKey(routeName, day, direction));
+    if (pendingJob)
+	return pendingJob;
+
+    KJob *fetchJob = fetchSchedule(keyForRoute(routeName), day, direction, RtdFetchJob::PrefetchPriority, false);
+    if (fetchJob)
+	addScheduleJob(fetchJob, JobData(routeName, day, direction));
+    return fetchJob;
+}
 
-	ret += '\n';
-    }
+// "WarmCache": load every direction of every route on every kind of day, so
+// that a new installation can answer everything from its cache. Requesting
+// the source starts the run; its data reports the progress.
+void RtdDenverEngine::startWarmCache()
+{
+    if (!m_warmJobs.isEmpty())
+	return;
 
-    return ret;
+    m_warmTotal = m_warmDone = m_warmFailed = 0;
+    foreach (const QString& routeName, m_routes.keys())
+	warmRoute(routeName);
+
+    updateWarmCache();
 }
 
-// use QtWebKit to parse RTD's (buggy) html, and then use some JavaScript to
-// pull out the elements we care about
-QVariantMap RtdDenverEngine::parseSchedule(const QByteArray& schedule) const
+void RtdDenverEngine::warmRoute(const QString& routeName)
 {
-    Plasma::DataEngine::Data schedules;
+    QString directions = m_routes[routeName].directions;
+
+    // one load with no direction tells us which ways the route runs; we
+    // come back for the rest once it's done
+    if (directions.isEmpty()) {
+	KJob *job = prefetchSchedule(routeName + "-?", Weekday);
+	if (job && !m_warmJobs.contains(job)) {
+	    m_warmJobs.insert(job);
+	    m_warmTotal++;
+	}
+	return;
+    }
 
-    QString scheduleHtml = QString::fromUtf8(schedule);
-    scheduleHtml.remove(QRegExp("<\\s*link[^>]+>"));
-    scheduleHtml.remove(QRegExp("<\\s*script[^>]+src\\s*=[^>]>\\s*<\\s*/\\s*script\\s*>"));
-    scheduleHtml.remove(QRegExp("<\\s*object[^>]+>"));
-    scheduleHtml.remove(QRegExp("<\\s*img[^>]+>"));
-    scheduleHtml.remove(QRegExp("<\\s*embed[^>]+>"));
+    QList<DayType> days;
+    days << Weekday << Saturday << SundayHoliday;
+    foreach (const QString& directionCode, directions.split('-')) {
+	foreach (DayType day, days) {
+	    KJob *job = prefetchSchedule(routeName + '-' + directionCode, day);
+	    if (job && !m_warmJobs.contains(job)) {
+		m_warmJobs.insert(job);
+		m_warmTotal++;
+	    }
+	}
+    }
+}
 
-    QWebPage page;
-    QWebSettings *settings = page.settings();
-    settings->setAttribute(QWebSettings::AutoLoadImages, false);
-    settings->setAttribute(QWebSettings::JavascriptEnabled, false);
-    settings->setAttribute(QWebSettings::JavaEnabled, false);
-    settings->setAttribute(QWebSettings::PluginsEnabled, false);
-    settings->setAttribute(QWebSettings::PrivateBrowsingEnabled, true);
+void RtdDenverEngine::warmJobFinished(KJob *job, const JobData& jd, bool ok)
+{
+    if (!m_warmJobs.remove(job))
+	return;
 
-    QWebFrame *frame = page.mainFrame();
+    if (ok)
+	m_warmDone++;
+    else
+	m_warmFailed++;
 
-    frame->setHtml(scheduleHtml);
+    // now that we know which ways this route runs, load them all
+    if (ok && jd.direction == '?' && !m_routes[jd.routeName].directions.isEmpty())
+	warmRoute(jd.routeName);
 
-    QFile parseScript(":/data/parseSchedule.js");
-    parseScript.open(QIODevice::ReadOnly);
-    QVariant jsRet = frame->evaluateJavaScript(parseScript.readAll());
+    // the store was held back while we were loading: write it all in one go
+    if (m_warmJobs.isEmpty())
+	writeStore();
 
-    return jsRet.toMap();
+    updateWarmCache();
 }
 
-// sort-of parse the JavaScript data structure that the RTD website uses
-// for its schedule menu
-QHash<QString, QString> RtdDenverEngine::parseRouteList(const QByteArray& scheduleList) const
+void RtdDenverEngine::updateWarmCache()
 {
-    QHash<QString, QString> routes;
-    QRegExp urlPattern("\\?(.+)$");
+    setData(QLatin1String("WarmCache"), QLatin1String("Total"), m_warmTotal);
+    setData(QLatin1String("WarmCache"), QLatin1String("Done"), m_warmDone);
+    setData(QLatin1String("WarmCache"), QLatin1String("Failed"), m_warmFailed);
+    setData(QLatin1String("WarmCache"), QLatin1String("Running"), !m_warmJobs.isEmpty());
+}
 
-    int nextPos = 0;
-    forever {
-	int textPos = scheduleList.indexOf("text:", nextPos);
-	if (textPos < 0)
-	    break;
+uint qHash(const RtdDenverEngine::FetchKey& key)
+{
+    return qHash(key.routeName) ^ (uint(key.day) << 8) ^ uint(key.direction);
+}
 
-	int firstQPos = scheduleList.indexOf("\"", textPos+5);
-	if (firstQPos < 0)
-	    break;
+void RtdDenverEngine::addScheduleJob(KJob *job, const JobData& jd)
+{
+    m_jobData.insert(job, jd);
+    m_scheduleJobs.insert(FetchKey(jd.routeName, jd.routeDay, jd.direction), job);
+}
 
-	int secondQPos = scheduleList.indexOf("\"", firstQPos+1);
-	if (secondQPos < 0)
-	    break;
+RtdDenverEngine::JobData RtdDenverEngine::takeScheduleJob(KJob *job)
+{
+    JobData jd = m_jobData.take(job);
+    FetchKey key(jd.routeName, jd.routeDay, jd.direction);
+    if (m_scheduleJobs.value(key) == job)
+	m_scheduleJobs.remove(key);
+    return jd;
+}
 
-	QString routeName = QString::fromAscii(scheduleList.mid(firstQPos+1, secondQPos - firstQPos - 1));
+// actually perform a network fetch of a schedule for a given route, day, and direction
+// direction == 0 means no direction specified
+KJob *RtdDenverEngine::fetchSchedule(const QString& query, DayType day, int direction, RtdFetchJob::Priority priority,
+				     bool conditional)
+{
+    QString scheduleUrl = m_baseUrl + QLatin1String("getSchedule.action?");
+    scheduleUrl += query;
+    scheduleUrl += QString(QLatin1String("&serviceType=%1")).arg(int(day));
 
-	int urlPos = scheduleList.indexOf("url:", secondQPos+1);
-	if (urlPos < 0)
+    if (direction) {
+	switch (direction) {
+	case 'N':
+	case 'S':
+	case 'E':
+	case 'W':
+	    scheduleUrl += QString(QLatin1String("&direction=%1-Bound")).arg(QChar(direction));
 	    break;
-
-	firstQPos = scheduleList.indexOf("\"", urlPos+4);
-	if (firstQPos < 0)
+	case 'C':
+	    scheduleUrl += QLatin1String("&direction=Clock");
 	    break;
-
-	secondQPos = scheduleList.indexOf("\"", firstQPos+1);
-	if (secondQPos < 0)
+	case 'c':
+	    scheduleUrl += QLatin1String("&direction=Counterclock");
 	    break;
-
-	QString routeUrlPart = QString::fromAscii(scheduleList.mid(firstQPos+1, secondQPos - firstQPos - 1));
-	if (urlPattern.indexIn(routeUrlPart) >= 0) {
-	    routes.insert(routeName, urlPattern.cap(1));
+	case 'L':
+	case '?':
+	    break;
+	default:
+	    kWarning() << "Unknown direction " << QChar(direction);
+	    return 0;
 	}
-
-	nextPos = secondQPos+1;
     }
 
-    return routes;
+    // we hang on to schedule jobs until their page has been parsed
+    RtdFetchJob *fetchJob = new RtdFetchJob(&m_fetchScheduler, KUrl(scheduleUrl), priority);
+    fetchJob->setAutoDelete(false);
+    fetchJob->setConditional(conditional);
+    fetchJob->setStreaming(true);
+    connect(fetchJob, SIGNAL(pageData(RtdFetchJob*,QByteArray)), this, SLOT(schedulePageData(RtdFetchJob*,QByteArray)));
+    connect(fetchJob, SIGNAL(pageRestarted(RtdFetchJob*)), this, SLOT(schedulePageRestarted(RtdFetchJob*)));
+    connect(fetchJob, SIGNAL(result(KJob*)), this, SLOT(schedulePageResult(KJob*)));
+    fetchJob->start();
+    m_stats.fetchesStarted++;
+    m_tracer.begin("schedule download", fetchJob, QString(), scheduleUrl);
+
+    return fetchJob;
+}
+
+// fetch the route list from RTD, using the JavaScript data structure they
+// use to back up the schedule menu on their website
+void RtdDenverEngine::fetchRouteList(RtdFetchJob::Priority priority, bool conditional)
+{
+    KUrl routeListUrl(m_baseUrl + QLatin1String("ajax/getAjaxRouteMenu.action"));
+
+    RtdFetchJob *fetchJob = new RtdFetchJob(&m_fetchScheduler, routeListUrl, priority);
+    fetchJob->setConditional(conditional);
+    connect(fetchJob, SIGNAL(result(KJob*)), this, SLOT(routeListResult(KJob*)));
+
+    m_routeListJob = fetchJob;
+    m_jobData.insert(fetchJob, JobData());
+    fetchJob->start();
+    m_stats.fetchesStarted++;
+    m_tracer.begin("route list fetch", fetchJob, QString(), routeListUrl.url());
 }
 
 enum {
-    ROUTE_LIST_FORMAT_VERSION = 1,
-    SCHEDULE_FORMAT_VERSION = 1
+    ROUTE_LIST_FORMAT_VERSION = 1
 };
 
 void RtdDenverEngine::saveRouteList() const
@@ -702,216 +1191,210 @@ QString RtdDenverEngine::dayTypeName(DayType day) const
     return QLatin1String("unknown");
 }
 
-QString RtdDenverEngine::scheduleFilePath(const QString& route, DayType day, int direction) const
+// work out where a freshly parsed schedule page should be filed. On entry
+// @p direction is the direction we asked for and @p validAsOf is what the
+// engine believed before the page was parsed; on return they say where the
+// timetable belongs.
+bool RtdDenverEngine::placeSchedule(const QString& route, const RtdSchedulePage& page, int *direction,
+				    QDate *validAsOf) const
 {
-    QString sanitizedRoute = route;
-    sanitizedRoute.replace('/', '_');
-
-    QString fileName = QLatin1String("Schedule-") +
-		       sanitizedRoute + '-' + QChar(direction) + '-' +
-		       dayTypeName(day) + QLatin1String(".dat");
-
-    return KStandardDirs::locateLocal("data", QLatin1String("plasma_engine_rtddenver/") + fileName);
-}
-
-static QTime parseRtdTime(const QString& str)
-{
-    int hr, min;
-    int digitCount = 0;
-
-    if (str.length() < 4)
-	return QTime();
-
-    for (int i = 0; i < str.length(); i++) {
-	if (str[i] < '0' || str[i] > '9')
-	    break;
-	digitCount++;
-    }
+    if (route.isEmpty() || page.status == RtdSchedulePage::Unreadable)
+	return false;
 
-    if (digitCount == 3) {
-	hr = str.left(1).toInt();
-	min = str.mid(1, 2).toInt();
-    } else if (digitCount == 4) {
-	hr = str.left(2).toInt();
-	min = str.mid(2, 2).toInt();
-    } else {
-	return QTime();
+    // if the route doesn't exist on this day, this leaves an empty timetable
+    if (page.status == RtdSchedulePage::Found) {
+	*validAsOf = page.validAsOf;
+	*direction = directionFromCode(page.direction);
     }
 
-    if (digitCount >= str.length())
-	return QTime();
-
-    if (hr == 12 && str[digitCount] == 'A')
-	hr -= 12;
-
-    if (str[digitCount] == 'P')
-	hr += 12;
-
-    return QTime(hr, min);
+    return validAsOf->isValid() && *direction != '?';
 }
 
-void RtdDenverEngine::saveSchedule(const QString& route, DayType day, int direction, const QVariantMap& schedule) const
+Plasma::DataEngine::Data RtdDenverEngine::loadSchedule(const RtdQuery::Stop& fullRoute, DayType day) const
 {
-    QFile scheduleFile(scheduleFilePath(route, day, direction));
-
-    if (!m_validAsOf.isValid() || !scheduleFile.open(QIODevice::WriteOnly))
-	return;
-
-    QDataStream out(&scheduleFile);
-    out << qint32(SCHEDULE_FORMAT_VERSION);
-    out << m_validAsOf;
-
-    for (QVariantMap::const_iterator it = schedule.constBegin(); it != schedule.constEnd(); it++) {
-	out << it.key();
-
-	QList< QPair<QTime, QString> > outputStopList;
-	QVariantList stops = it.value().toList();
-	foreach (const QVariant& stop, stops) {
-	    QVariantMap stopData = stop.toMap();
-	    TimeRoutePair p;
+    Plasma::DataEngine::Data data;
 
-	    p.first = parseRtdTime(stopData[QLatin1String("time")].toString().trimmed());
+    // the store only holds schedules for one validity date
+    if (!m_validAsOf.isValid() || m_store->validAsOf() != m_validAsOf)
+	return data;
 
-	    if (stopData.contains(QLatin1String("route")))
-		p.second = stopData[QLatin1String("route")].toString();
-	    else
-		p.second = route;
+    RtdTimetableStore::Route route = m_store->route(fullRoute.routeName, day, fullRoute.direction);
+    if (!route.isValid())
+	return data;
 
-	    if (p.first.isValid())
-		outputStopList.append(p);
+    QVector<quint32> subroutes = route.subroutes();
+    for (int stop = 0; stop < route.stopCount(); stop++) {
+	QList<TimeRoutePair> stops;
+	int count = route.departureCount(stop);
+	const quint16 *minutes = route.minutes(stop);
+	const quint16 *subrouteIndexes = route.subrouteIndexes(stop);
+
+	for (int i = 0; i < count; i++) {
+	    QTime time((minutes[i] % 1440) / 60, minutes[i] % 60);
+	    QString subroute = (subrouteIndexes[i] < subroutes.size() ? m_names.string(subroutes[subrouteIndexes[i]])
+								      : fullRoute.routeName);
+	    stops << qMakePair(time, subroute);
 	}
-	out << outputStopList;
+	data.insert(m_names.string(route.station(stop)), qVariantFromValue(stops));
     }
+//    kDebug() << "loaded " << fullRoute.fullRouteName << "from cache";
+
+    return data;
 }
 
-Plasma::DataEngine::Data RtdDenverEngine::loadSchedule(const QString& fullRouteName, DayType day) const
+// load the timetable of just one station of a route, shifting its departures
+// by @p dayOffset minutes. This returns whether we have the route's schedule
+// at all, since a stop may well have no buses on a given day.
+bool RtdDenverEngine::loadScheduleForStop(const RtdQuery::Stop& routeStop, DayType day, int dayOffset,
+					  StopTimetable *timetable) const
 {
-    Plasma::DataEngine::Data data;
-
-//    kDebug() << "trying to load " << fullRouteName;
-    QStringList parts = fullRouteName.split('-');
-    if (parts.length() != 2)
-	return data;
-
-    QFile scheduleFile(scheduleFilePath(parts.first(), day, directionFromCode(parts.last())));
-
-    if (!scheduleFile.exists() || !scheduleFile.open(QIODevice::ReadOnly))
-	return data;
-
-//    kDebug() << "cache file found for " << fullRouteName;
-    QDataStream in(&scheduleFile);
+    if (!m_validAsOf.isValid() || m_store->validAsOf() != m_validAsOf)
+	return false;
 
-    qint32 version;
-    QDate validAsOf;
-    in >> version;
-    if (version != SCHEDULE_FORMAT_VERSION)
-	goto remove;
+    RtdTimetableStore::Route route = m_store->route(routeStop.routeId, day, routeStop.direction);
+    if (!route.isValid())
+	return false;
 
-    in >> validAsOf;
-    if (validAsOf != m_validAsOf)
-	goto remove;
+    int stop = (routeStop.stationId != quint32(RtdInternTable::NoId) ? route.findStation(routeStop.stationId) : -1);
+    if (stop < 0)
+	return true;
 
-    while (!in.atEnd()) {
-	QString station;
-	in >> station;
-	QList<TimeRoutePair> stops;
-	in >> stops;
-	data.insert(station, qVariantFromValue(stops));
+    quint32 routeId = routeStop.routeId;
+    QVector<quint32> subroutes = route.subroutes();
+    int count = route.departureCount(stop);
+    const quint16 *minutes = route.minutes(stop);
+    const quint16 *subrouteIndexes = route.subrouteIndexes(stop);
+
+    StopTimetable dayTimetable;
+    dayTimetable.minutes.reserve(count);
+    dayTimetable.subroutes.reserve(count);
+    for (int i = 0; i < count; i++) {
+	quint32 subroute = (subrouteIndexes[i] < subroutes.size() ? subroutes[subrouteIndexes[i]] : routeId);
+	dayTimetable.append(minutes[i] + dayOffset, subroute);
     }
-//    kDebug() << "loaded " << fullRouteName << "from cache";
-    return data;
+    timetable->merge(dayTimetable);
 
-remove:
-    scheduleFile.close();
-    scheduleFile.remove();
-    return Plasma::DataEngine::Data();
+    return true;
 }
 
 // the heart of the data engine: figure out what and when the next routes are to
 // stop at the location(s) of interest
-QList<DateTimeRoutePair> RtdDenverEngine::stopsForCurrentDateTime(const QString& sourceName, const QStringList& routes, int n, bool *ok)
+bool RtdDenverEngine::setupNextStopsCursor(const QString& sourceName, RtdQuery *query, const QDateTime& now,
+					   NextStopsCursor *cursor, bool *ok)
 {
-    QList<DateTimeRoutePair> mergedStops;
+    StopTimetables timetables;
     *ok = true;
 
-    // we keep a single-element memory cache of the most recently requested
-    // route list, to try to reduce how often we hit the hard drive
-    if (m_cachedRouteList == routes && m_cachedRouteDate == QDate::currentDate()) {
-	mergedStops = m_cachedStops;
-    } else {
-	QList<QList<TimeRoutePair> > allSchedules;
+    // we keep a memory cache of the timetables of the most recently requested
+    // route lists, to try to reduce how often we hit the hard drive
+    QString cacheKey = RtdNextStopsCache::key(query->stopSet, now.date());
+    if (!m_nextStopsCache.find(cacheKey, &timetables)) {
 	bool loadPending = false;
 
-	// collect all the data we need
+	// names we hadn't seen when the source was compiled may be in the store by now
+	query->resolve(m_names);
+
+	// collect all the data we need: tomorrow's buses count from the start of
+	// today too, so that each stop's timetable is one sorted list
 	QList<DayType> days;
 	days << dayType(Today) << dayType(Tomorrow);
-	foreach (const QString& route, routes) {
-	    int colon = route.indexOf(':');
-	    if (colon < 0) {
-		*ok = false;
-		return QList<DateTimeRoutePair>();
-	    }
-	    QString routeName = route.left(colon);
-
-	    QList<TimeRoutePair> thisStop;
+	foreach (const RtdQuery::Stop& routeStop, query->stops) {
+	    StopTimetable thisStop;
 
 	    for (int i = 0; i < 2; i++) {
-		if (i == 1 && days[1] == days[0]) {
-		    // no need to hit disk again: just duplicate "today" into "tomorrow"
-		    thisStop.append(thisStop);
-		    break;
-		}
 		DayType dt = days[i];
-		Plasma::DataEngine::Data d = loadSchedule(routeName, dt);
-		if (d.isEmpty()) {
+		if (!loadScheduleForStop(routeStop, dt, i * 1440, &thisStop)) {
 		    // queue a network load if we don't already have the schedule
-		    bool loadStarted = setupScheduleFetch(sourceName, routeName, dt);
+		    bool loadStarted = setupScheduleFetch(sourceName, routeStop.fullRouteName, dt);
 		    if (!loadStarted) {
 			*ok = false;
-			return QList<DateTimeRoutePair>();
+			return false;
 		    }
 		    loadPending = true;
-		} else {
-		    QVariant v = d[route.mid(colon + 1)];
-		    thisStop.append(qVariantValue< QList<TimeRoutePair> >(v));
+
+		    // no need to queue the same load twice
+		    if (days[1] == days[0])
+			break;
 		}
 	    }
-	    allSchedules << thisStop;
+	    timetables << thisStop;
 	}
 
 	// we have a pending load, but everything is ok otherwise
 	if (loadPending)
-	    return QList<DateTimeRoutePair>();
-
-	// convert the TimeRouteLists to a DateTimeRouteList suitable for sorting
-	foreach (const QList<TimeRoutePair>& schedule, allSchedules) {
-	    QDate day = QDate::currentDate();
-	    bool pm = false;
-	    foreach (const TimeRoutePair& tr, schedule) {
-		if (tr.first.hour() >= 12)
-		    pm = true;
-		if (pm && tr.first.hour() < 12) {
-		    pm = false;
-		    day = day.addDays(1);
-		}
-		mergedStops << qMakePair(QDateTime(day, tr.first), tr.second);
-	    }
-	}
-	qSort(mergedStops.begin(), mergedStops.end());
+	    return false;
 
-	// cache the merged stops list
-	m_cachedRouteList = routes;
-	m_cachedRouteDate = QDate::currentDate();
-	m_cachedStops = mergedStops;
+	m_nextStopsCache.insert(cacheKey, timetables);
     }
 
-    // now we've got the complete list of stops for the stations and routes of interest,
-    // pick out the @p n next stops
-    QDateTime now = QDateTime::currentDateTime();
-    int start = 0;
-    while (start < mergedStops.length() && now >= mergedStops[start].first)
-	start++;
-    return mergedStops.mid(start, n);
+    // now we've got the timetables for the stations and routes of interest,
+    // the source's cursor merges them as it walks them
+    cursor->reset(timetables, now.date(), m_validAsOf, now);
+    return true;
+}
+
+void RtdDenverEngine::updateCacheStats()
+{
+    QString sourceName = QLatin1String("CacheStats");
+    setData(sourceName, QLatin1String("hits"), m_nextStopsCache.hits());
+    setData(sourceName, QLatin1String("misses"), m_nextStopsCache.misses());
+    setData(sourceName, QLatin1String("entries"), m_nextStopsCache.count());
+    setData(sourceName, QLatin1String("bytes"), m_nextStopsCache.bytes());
+}
+
+// note how a fetch went, for the "Stats" source
+void RtdDenverEngine::recordFetch(KJob *job)
+{
+    RtdFetchJob *fetchJob = static_cast<RtdFetchJob *>(job);
+    m_stats.fetchBytes.record(fetchJob->bytesReceived());
+    if (job->error())
+	m_stats.fetchesFailed++;
+    else if (fetchJob->isNotModified())
+	m_stats.fetchesNotModified++;
+}
+
+// close the span of a fetch, noting who was waiting and how it went
+void RtdDenverEngine::traceFetchEnd(const char *name, KJob *job, const QSet<QString>& sources)
+{
+    if (!m_tracer.isEnabled())
+	return;
+
+    RtdFetchJob *fetchJob = static_cast<RtdFetchJob *>(job);
+    QString detail;
+    if (job->error())
+	detail = job->errorString();
+    else if (fetchJob->isNotModified())
+	detail = QLatin1String("not modified");
+    else
+	detail = QString(QLatin1String("%1 bytes")).arg(fetchJob->bytesReceived());
+    detail += QString(QLatin1String(", %1 attempts")).arg(fetchJob->attempts());
+
+    m_tracer.end(name, job, QStringList(sources.toList()).join(QLatin1String(", ")), detail);
+}
+
+void RtdDenverEngine::updateStats()
+{
+    QString sourceName = QLatin1String("Stats");
+    setData(sourceName, QLatin1String("fetchesStarted"), m_stats.fetchesStarted);
+    setData(sourceName, QLatin1String("fetchesCoalesced"), m_stats.fetchesCoalesced);
+    setData(sourceName, QLatin1String("validityPiggybacks"), m_stats.validityPiggybacks);
+    setData(sourceName, QLatin1String("fetchesFailed"), m_stats.fetchesFailed);
+    setData(sourceName, QLatin1String("fetchesNotModified"), m_stats.fetchesNotModified);
+    setData(sourceName, QLatin1String("fetchRetries"), m_fetchScheduler.retries());
+    setData(sourceName, QLatin1String("fetchesRunning"), m_fetchScheduler.running());
+    setData(sourceName, QLatin1String("fetchesQueued"), m_fetchScheduler.queued());
+    setData(sourceName, QLatin1String("fetchBytes"), m_stats.fetchBytes.toVariant());
+    setData(sourceName, QLatin1String("parseTime"), m_stats.parseTime.toVariant());
+    setData(sourceName, QLatin1String("loadTime"), m_stats.loadTime.toVariant());
+    setData(sourceName, QLatin1String("nextStopsTime"), m_stats.nextStopsTime.toVariant());
+
+    int lookups = m_nextStopsCache.hits() + m_nextStopsCache.misses();
+    setData(sourceName, QLatin1String("nextStopsCacheHitRate"),
+	    lookups ? double(m_nextStopsCache.hits()) / lookups : 0.0);
+
+    // waiting on the route list or on schedule loads, and given up on for now
+    setData(sourceName, QLatin1String("pendingSources"), m_pendingRoutes.size() + m_pendingSchedules.size());
+    setData(sourceName, QLatin1String("failedSources"), m_failedSources.size());
 }
 
 K_EXPORT_PLASMA_DATAENGINE(rtddenver, RtdDenverEngine)
@@ -29,14 +29,25 @@
 #include <QtCore/QSet>
 #include <QtCore/QString>
 #include <QtCore/QStringList>
+#include <QtCore/QThreadPool>
+#include <QtCore/QTimer>
 
 #include <Plasma/DataEngine>
 
+#include "rtddepartures.h"
+#include "rtdfetchjob.h"
+#include "rtdinterntable.h"
+#include "rtdnextstopscache.h"
+#include "rtdquery.h"
+#include "rtdschedule.h"
+#include "rtdstats.h"
+#include "rtdtimetablestore.h"
+#include "rtdtrace.h"
+
 class KJob;
-namespace KIO { class Job; };
+class RtdParseJob;
 
 typedef QPair<QTime, QString> TimeRoutePair;
-typedef QPair<QDateTime, QString> DateTimeRoutePair;
 Q_DECLARE_METATYPE(QList<TimeRoutePair>)
 Q_DECLARE_METATYPE(QList<DateTimeRoutePair>)
 
@@ -44,6 +55,8 @@ class RtdDenverEngine : public Plasma::DataEngine
 {
     Q_OBJECT
 
+    friend class RtdParseJob;
+
     public:
 	RtdDenverEngine(QObject *parent, const QVariantList& args);
 	~RtdDenverEngine();
@@ -54,9 +67,17 @@ class RtdDenverEngine : public Plasma::DataEngine
         bool updateSourceEvent(const QString& sourceName);
 
     private slots:
-	void dataReceived(KIO::Job *job, const QByteArray& data);
 	void routeListResult(KJob *job);
+	void schedulePageData(RtdFetchJob *job, const QByteArray& data);
+	void schedulePageRestarted(RtdFetchJob *job);
 	void schedulePageResult(KJob *job);
+	void scheduleParsed(RtdParseJob *parseJob);
+	void writeStore();
+	void storeWritten(int epoch, int generation, bool ok);
+	void forgetSource(const QString& sourceName);
+	void updateNextStops();
+	void retryFailedSources();
+	void prefetch();
 
     private:
 	enum DayType {
@@ -69,45 +90,85 @@ class RtdDenverEngine : public Plasma::DataEngine
 	    Tomorrow
 	};
 	DayType dayType(TodayTomorrow tt) const;
+	static DayType dayTypeOf(const QDate& date);
 	QString dayTypeName(DayType d) const;
 
 	bool schedulesValid() const { return (m_validCheckedDate == QDate::currentDate()); }
+	bool servingStale() const { return m_serveStale && m_validAsOf.isValid(); }
 	void checkValidity(const QString& sourceName);
 
 	bool setupScheduleFetch(const QString& sourceName, const QString& fullRouteName, DayType day);
+	void schedulePrefetch();
+	QStringList routesOfSource(const QString& sourceName) const;
+	KJob *prefetchSchedule(const QString& fullRouteName, DayType day);
 	void maybeRetrySource(const QString& sourceName, KJob *completedJob);
-	KJob *fetchSchedule(const QString& routeName, DayType day, int direction);
-	KJob *fetchRouteList();
-
-	QVariantMap parseSchedule(const QByteArray& schedule) const;
-	QHash<QString, QString> parseRouteList(const QByteArray& routeList) const;
+	void failSource(const QString& sourceName, const QString& error);
+	KJob *fetchSchedule(const QString& routeName, DayType day, int direction, RtdFetchJob::Priority priority,
+			    bool conditional);
+	void fetchRouteList(RtdFetchJob::Priority priority, bool conditional);
 
 	void saveRouteList() const;
 	bool loadRouteList();
 	QString keyForRoute(const QString& route) const { return m_routes[route].key; }
 	QStringList routeList() const { return m_routes.keys(); }
 
-	QString scheduleFilePath(const QString& route, DayType day, int direction) const;
-	void saveSchedule(const QString& route, DayType day, int direction, const QVariantMap& schedule) const;
-	Plasma::DataEngine::Data loadSchedule(const QString& fullRouteName, DayType day) const;
+	// this is called from the parse worker threads, so it may only touch
+	// state that is fixed after construction
+	bool placeSchedule(const QString& route, const RtdSchedulePage& page, int *direction, QDate *validAsOf) const;
+	Plasma::DataEngine::Data loadSchedule(const RtdQuery::Stop& fullRoute, DayType day) const;
+	bool loadScheduleForStop(const RtdQuery::Stop& routeStop, DayType day, int dayOffset,
+				 StopTimetable *timetable) const;
 
-	QList<DateTimeRoutePair> stopsForCurrentDateTime(const QString& sourceName, const QStringList& routes, int nr, bool *ok);
+	RtdQuery *queryFor(const QString& sourceName);
+	bool setupNextStopsCursor(const QString& sourceName, RtdQuery *query, const QDateTime& now,
+				  NextStopsCursor *cursor, bool *ok);
+	void scheduleNextStopsUpdate();
+	void updateCacheStats();
+	void updateStats();
+	void recordFetch(KJob *job);
 
 	struct JobData {
 	    QSet<QString> pendingSources;
 	    QString routeName;
-	    QByteArray networkData;
 	    int direction;
 	    DayType routeDay;
+	    RtdParseJob *parseJob;      // parsing the page as it comes in
 
-	    JobData() { }
+	    JobData() : parseJob(0) { }
+	    JobData(const QString& r, DayType d, int dir)
+	      : routeName(r), direction(dir), routeDay(d), parseJob(0) { }
 	    JobData(const QString& n, const QString& r, DayType d, int dir)
-	      : routeName(r), direction(dir), routeDay(d) { pendingSources.insert(n); }
+	      : routeName(r), direction(dir), routeDay(d), parseJob(0) { pendingSources.insert(n); }
 	};
 
-	// this tells each job what it was and which sources are waiting on it
+	// this tells each job what it was and which sources are waiting on it; schedule
+	// jobs stay in here until their page has been parsed
 	QMap<KJob *, JobData> m_jobData;
 
+	// an index of the schedule jobs in m_jobData by what they are fetching, so
+	// that sources wanting the same page can join the load that's under way
+	struct FetchKey {
+	    QString routeName;
+	    DayType day;
+	    int direction;
+
+	    FetchKey() { }
+	    FetchKey(const QString& r, DayType d, int dir) : routeName(r), day(d), direction(dir) { }
+	    bool operator==(const FetchKey& other) const
+	    { return routeName == other.routeName && day == other.day && direction == other.direction; }
+	};
+	friend uint qHash(const FetchKey& key);
+	QHash<FetchKey, KJob *> m_scheduleJobs;
+
+	void addScheduleJob(KJob *job, const JobData& jd);
+	JobData takeScheduleJob(KJob *job);
+	RtdParseJob *parseJobFor(KJob *job);
+
+	void startWarmCache();
+	void warmRoute(const QString& routeName);
+	void warmJobFinished(KJob *job, const JobData& jd, bool ok);
+	void updateWarmCache();
+
 	// this tells each source what jobs it is waiting on
 	QHash<QString, QSet<KJob *> > m_pendingSchedules;
 
@@ -122,12 +183,76 @@ class RtdDenverEngine : public Plasma::DataEngine
 
 	QHash<QString, RouteData> m_routes;
 	QSet<QString> m_pendingRoutes;
+	KJob *m_routeListJob;
 	QDate m_validCheckedDate;
 	QDate m_validAsOf;
 
-	QDate m_cachedRouteDate;
-	QStringList m_cachedRouteList;
-	QList<DateTimeRoutePair> m_cachedStops;
+	// whether to answer from the cache while the daily validity check runs
+	bool m_serveStale;
+
+	// the per-stop timetables of the most recently requested sets of stops
+	RtdNextStopsCache m_nextStopsCache;
+
+	// where each distinct set of NextStops stops is up to in today's departures;
+	// the sources following it differ only in how many buses they list, and how
+	struct NextStopsStream {
+	    NextStopsCursor cursor;
+	    QSet<QString> sources;
+	};
+	QHash<QString, NextStopsStream> m_nextStopsStreams;   // by RtdQuery::stopSet
+	void publishNextStops(NextStopsStream& stream, const QStringList& sourceNames, const QDateTime& now);
+
+	// the NextStops and ScheduleOf sources, compiled
+	QHash<QString, RtdQuery> m_queries;
+
+	// fires when the first NextStops source is due to change
+	QTimer m_nextStopsTimer;
+
+	QString m_cacheDir;
+	QString m_baseUrl;
+	QThreadPool m_parsePool;
+	RtdFetchScheduler m_fetchScheduler;
+
+	// fetches the coming days' schedules for the routes people are watching
+	bool m_prefetch;
+	QTimer m_prefetchTimer;
+
+	// the schedule loads of a "WarmCache" run that are still outstanding
+	QSet<KJob *> m_warmJobs;
+	int m_warmTotal;
+	int m_warmDone;
+	int m_warmFailed;
+
+	// sources whose loads failed for good; they get another try now and then
+	QSet<QString> m_failedSources;
+	QTimer m_retryTimer;
+
+	// what the engine has been up to, for the "Stats" source; the times are
+	// in microseconds
+	struct Stats {
+	    qint64 fetchesStarted;
+	    qint64 fetchesCoalesced;    // sources that joined a fetch already under way
+	    qint64 validityPiggybacks;  // validity checks done by raising a fetch under way
+	    qint64 fetchesFailed;
+	    qint64 fetchesNotModified;
+	    RtdHistogram fetchBytes;
+	    RtdHistogram parseTime;
+	    RtdHistogram loadTime;
+	    RtdHistogram nextStopsTime;
+
+	    Stats() : fetchesStarted(0), fetchesCoalesced(0), validityPiggybacks(0), fetchesFailed(0), fetchesNotModified(0) { }
+	};
+	Stats m_stats;
+
+	// where the time goes, if [Debug] TraceFile asks for a trace
+	RtdTracer m_tracer;
+	void traceFetchEnd(const char *name, KJob *job, const QSet<QString>& sources);
+
+	// ids for the route, station and subroute names in the store and the timetables
+	RtdInternTable m_names;
+	RtdTimetableStore *m_store;
+	QTimer m_storeTimer;
+	bool m_storeWriteInFlight;
 };
 
 #endif
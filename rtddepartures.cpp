@@ -0,0 +1,172 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "rtddepartures.h"
+
+#include <algorithm>
+
+#include "rtdinterntable.h"
+
+void StopTimetable::append(int minute, quint32 subroute)
+{
+    minutes.append(minute);
+    subroutes.append(subroute);
+}
+
+// fold another sorted timetable into this one, keeping it sorted
+void StopTimetable::merge(const StopTimetable& other)
+{
+    // the usual case: tomorrow's buses all leave after today's
+    if (minutes.isEmpty() || other.minutes.isEmpty() || minutes.last() <= other.minutes.first()) {
+	minutes += other.minutes;
+	subroutes += other.subroutes;
+	return;
+    }
+
+    StopTimetable merged;
+    merged.minutes.reserve(count() + other.count());
+    merged.subroutes.reserve(count() + other.count());
+
+    int i = 0, j = 0;
+    while (i < count() || j < other.count()) {
+	if (j >= other.count() || (i < count() && minutes[i] <= other.minutes[j])) {
+	    merged.append(minutes[i], subroutes[i]);
+	    i++;
+	} else {
+	    merged.append(other.minutes[j], other.subroutes[j]);
+	    j++;
+	}
+    }
+
+    *this = merged;
+}
+
+int departureLowerBound(const int *minutes, int count, int minute)
+{
+    if (count <= 0)
+	return 0;
+
+    // a binary search whose only branch is the loop: the comparison turns
+    // into a conditional move
+    const int *base = minutes;
+    int n = count;
+    while (n > 1) {
+	int half = n / 2;
+	base = (base[half] < minute) ? base + half : base;
+	n -= half;
+    }
+
+    return (base - minutes) + (*base < minute);
+}
+
+static QDateTime departureTime(const QDate& serviceDate, int minute)
+{
+    return QDateTime(serviceDate.addDays(minute / 1440), QTime((minute % 1440) / 60, minute % 60));
+}
+
+void NextStopsCursor::reset(const StopTimetables& timetables, const QDate& serviceDate, const QDate& validAsOf,
+			    const QDateTime& now)
+{
+    m_timetables = timetables;
+    m_serviceDate = serviceDate;
+    m_validAsOf = validAsOf;
+    seek(minuteOf(now));
+}
+
+int NextStopsCursor::minuteOf(const QDateTime& now) const
+{
+    return m_serviceDate.daysTo(now.date()) * 1440 + now.time().hour() * 60 + now.time().minute();
+}
+
+// heap ordering: the stop with the earliest next departure is on top
+bool NextStopsCursor::laterPosition(const Position& a, const Position& b)
+{
+    return b.minute < a.minute;
+}
+
+// put each stop at its first bus after @p minute, and heap them up
+void NextStopsCursor::seek(int minute)
+{
+    m_heap.clear();
+    m_heap.reserve(m_timetables.size());
+    for (int i = 0; i < m_timetables.size(); i++) {
+	const StopTimetable& timetable = m_timetables[i];
+	int pos = departureLowerBound(timetable.minutes.constData(), timetable.count(), minute + 1);
+	if (pos >= timetable.count())
+	    continue;
+
+	Position position;
+	position.minute = timetable.minutes[pos];
+	position.stop = i;
+	position.pos = pos;
+	m_heap.append(position);
+    }
+    std::make_heap(m_heap.begin(), m_heap.end(), laterPosition);
+    m_minute = minute;
+}
+
+// move the stop on top of @p heap on to its next bus
+void NextStopsCursor::advance(QVector<Position> *heap) const
+{
+    std::pop_heap(heap->begin(), heap->end(), laterPosition);
+    Position& position = heap->last();
+    const StopTimetable& timetable = m_timetables[position.stop];
+    if (++position.pos < timetable.count()) {
+	position.minute = timetable.minutes[position.pos];
+	std::push_heap(heap->begin(), heap->end(), laterPosition);
+    } else {
+	heap->pop_back();
+    }
+}
+
+QList<DateTimeRoutePair> NextStopsCursor::next(const QDateTime& now, int n, const RtdInternTable& names)
+{
+    // if the clock went backwards (say, at the end of daylight saving time),
+    // find our place again rather than skip buses
+    int nowMinute = minuteOf(now);
+    if (nowMinute < m_minute)
+	seek(nowMinute);
+
+    // a bus that left earlier this minute is gone
+    while (!m_heap.isEmpty() && m_heap.first().minute <= nowMinute)
+	advance(&m_heap);
+    m_minute = nowMinute;
+
+    // the next n come off a scratch copy of the k-entry heap, leaving our
+    // place where it is
+    QList<DateTimeRoutePair> ret;
+    QVector<Position> heap = m_heap;
+    while (!heap.isEmpty() && ret.size() < n) {
+	const Position& top = heap.first();
+	ret << qMakePair(departureTime(m_serviceDate, top.minute),
+			 names.string(m_timetables[top.stop].subroutes[top.pos]));
+	advance(&heap);
+    }
+
+    return ret;
+}
+
+QDateTime NextStopsCursor::nextChange() const
+{
+    int minute = 1440;
+    if (!m_heap.isEmpty() && m_heap.first().minute < minute)
+	minute = m_heap.first().minute;
+
+    return departureTime(m_serviceDate, minute);
+}
@@ -0,0 +1,98 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RTDDEPARTURES_H
+#define RTDDEPARTURES_H
+
+#include <QtCore/QDate>
+#include <QtCore/QDateTime>
+#include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+class RtdInternTable;
+
+typedef QPair<QDateTime, QString> DateTimeRoutePair;
+
+// One stop's departures over today's and tomorrow's service, as minutes past
+// midnight at the start of today: anything after midnight is 1440 or more.
+// The minutes are sorted, and subroutes runs parallel to them, holding each
+// bus's subroute as an id in the engine's intern table.
+struct StopTimetable {
+    QVector<int> minutes;
+    QVector<quint32> subroutes;
+
+    int count() const { return minutes.size(); }
+    void append(int minute, quint32 subroute);
+    void merge(const StopTimetable& other);
+};
+
+// the timetables of each of the stops of a NextStops query
+typedef QList<StopTimetable> StopTimetables;
+
+// the index of the first of the @p count sorted @p minutes that is >= @p minute
+int departureLowerBound(const int *minutes, int count, int minute);
+
+// A position in the departures of one NextStops query, merged lazily from its
+// stops' timetables. Setting it up binary searches each stop for the first bus
+// after now and puts the k stops on a heap; from then on it only moves forward
+// as buses leave, so asking it for the next n departures costs O(n log k) plus
+// the buses that have left since last time, not a merge of the whole day.
+class NextStopsCursor
+{
+    public:
+	NextStopsCursor() : m_minute(0) { }
+
+	// @p timetables count their minutes from the start of @p serviceDate
+	void reset(const StopTimetables& timetables, const QDate& serviceDate, const QDate& validAsOf,
+		   const QDateTime& now);
+
+	// whether the cursor still describes today's schedules
+	bool isCurrent(const QDate& today, const QDate& validAsOf) const
+	{ return m_serviceDate.isValid() && m_serviceDate == today && m_validAsOf == validAsOf; }
+
+	// the @p n next departures after @p now, with their subroutes looked up in @p names
+	QList<DateTimeRoutePair> next(const QDateTime& now, int n, const RtdInternTable& names);
+
+	// when the departures last handed out by next() will change: either
+	// the first of them leaves, or the service day ends
+	QDateTime nextChange() const;
+
+    private:
+	// one stop's place in the merge
+	struct Position {
+	    int minute;         // of the stop's next departure
+	    int stop;
+	    int pos;
+	};
+
+	static bool laterPosition(const Position& a, const Position& b);
+	int minuteOf(const QDateTime& now) const;
+	void seek(int minute);
+	void advance(QVector<Position> *heap) const;
+
+	StopTimetables m_timetables;
+	QVector<Position> m_heap;   // the earliest next departure on top
+	QDate m_serviceDate;
+	QDate m_validAsOf;
+	int m_minute;               // everything up to this minute has left
+};
+
+#endif
@@ -0,0 +1,350 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "rtdfetchjob.h"
+
+#include <KDE/KIO/Job>
+#include <KDE/KIO/TransferJob>
+
+#include <QtCore/QDataStream>
+#include <QtCore/QFile>
+#include <QtCore/QStringList>
+
+enum {
+    ATTEMPT_TIMEOUT = 30*1000,
+    FETCH_DEADLINE = 2*60*1000,
+    QUEUE_DEADLINE = 60*1000,       // how long a UserPriority job may wait for a slot
+    MAX_ATTEMPTS = 3,
+    RETRY_DELAY = 2*1000,
+    MAX_PREALLOCATION = 4*1024*1024,
+    VALIDATORS_FORMAT_VERSION = 1
+};
+
+RtdFetchJob::RtdFetchJob(RtdFetchScheduler *scheduler, const KUrl& url, Priority priority)
+    : m_scheduler(scheduler),
+      m_url(url),
+      m_priority(priority),
+      m_transfer(0),
+      m_bytesReceived(0),
+      m_attempts(0),
+      m_conditional(false),
+      m_streaming(false),
+      m_notModified(false),
+      m_finished(false)
+{
+    m_attemptTimer.setSingleShot(true);
+    m_attemptTimer.setInterval(ATTEMPT_TIMEOUT);
+    connect(&m_attemptTimer, SIGNAL(timeout()), this, SLOT(attemptTimedOut()));
+
+    m_deadlineTimer.setSingleShot(true);
+    m_deadlineTimer.setInterval(FETCH_DEADLINE);
+    connect(&m_deadlineTimer, SIGNAL(timeout()), this, SLOT(deadlineExpired()));
+
+    m_queueTimer.setSingleShot(true);
+    m_queueTimer.setInterval(QUEUE_DEADLINE);
+    connect(&m_queueTimer, SIGNAL(timeout()), this, SLOT(deadlineExpired()));
+}
+
+RtdFetchJob::~RtdFetchJob()
+{
+    if (m_transfer)
+	m_transfer->kill();
+    if (!m_finished)
+	m_scheduler->forget(this, m_transfer != 0);
+}
+
+void RtdFetchJob::start()
+{
+    // the deadline only starts once we're on the network, so that a long
+    // queue of prefetches doesn't time out before it gets going
+    if (m_priority == UserPriority)
+	m_queueTimer.start();
+    m_scheduler->enqueue(this);
+}
+
+void RtdFetchJob::raisePriority(Priority priority)
+{
+    if (priority >= m_priority)
+	return;
+
+    Priority oldPriority = m_priority;
+    m_priority = priority;
+    if (!m_finished) {
+	m_scheduler->reprioritize(this, oldPriority);
+	if (priority == UserPriority && m_attempts == 0)
+	    m_queueTimer.start();
+    }
+}
+
+// called by the scheduler once we have a network slot
+void RtdFetchJob::startTransfer()
+{
+    m_queueTimer.stop();
+    if (m_attempts == 0)
+	m_deadlineTimer.start();
+    m_attempts++;
+    m_data.clear();
+    if (m_streaming && m_attempts > 1)
+	emit pageRestarted(this);
+
+    // ask the server to skip the page if it's the one we already have; this
+    // has to bypass KIO's own cache to get to the server at all
+    QStringList headers;
+    if (m_conditional) {
+	RtdFetchScheduler::Validator validator = m_scheduler->m_validators.value(m_url.url());
+	if (!validator.etag.isEmpty())
+	    headers << QLatin1String("If-None-Match: ") + validator.etag;
+	if (!validator.lastModified.isEmpty())
+	    headers << QLatin1String("If-Modified-Since: ") + validator.lastModified;
+    }
+
+    m_transfer = KIO::get(m_url, headers.isEmpty() ? KIO::NoReload : KIO::Reload, KIO::HideProgressInfo);
+    m_transfer->addMetaData(QLatin1String("PropagateHttpHeader"), QLatin1String("true"));
+    // an HTTP error should fail the attempt, not arrive as the page
+    m_transfer->addMetaData(QLatin1String("errorPage"), QLatin1String("false"));
+    if (!headers.isEmpty())
+	m_transfer->addMetaData(QLatin1String("customHTTPHeader"), headers.join(QLatin1String("\r\n")));
+    connect(m_transfer, SIGNAL(data(KIO::Job*,QByteArray)), this, SLOT(transferData(KIO::Job*,QByteArray)));
+    connect(m_transfer, SIGNAL(totalSize(KJob*,qulonglong)), this, SLOT(transferTotalSize(KJob*,qulonglong)));
+    connect(m_transfer, SIGNAL(result(KJob*)), this, SLOT(transferResult(KJob*)));
+    m_attemptTimer.start();
+}
+
+void RtdFetchJob::transferData(KIO::Job *transfer, const QByteArray& data)
+{
+    if (transfer != m_transfer || data.isEmpty())
+	return;
+
+    m_bytesReceived += data.size();
+    if (m_streaming)
+	emit pageData(this, data);
+    else
+	m_data += data;
+}
+
+// the server told us how big the page is: make room for it all at once
+void RtdFetchJob::transferTotalSize(KJob *transfer, qulonglong size)
+{
+    if (transfer == m_transfer && !m_streaming && size <= MAX_PREALLOCATION)
+	m_data.reserve(int(size));
+}
+
+void RtdFetchJob::transferResult(KJob *transfer)
+{
+    if (transfer != m_transfer)
+	return;
+
+    m_attemptTimer.stop();
+    m_transfer = 0;
+    m_scheduler->transferFinished();
+
+    KIO::TransferJob *transferJob = static_cast<KIO::TransferJob *>(transfer);
+    if (transferJob->queryMetaData(QLatin1String("responsecode")) == QLatin1String("304")) {
+	m_notModified = true;
+	m_data.clear();
+	finish(0, QString());
+	return;
+    }
+
+    if (transfer->error()) {
+	attemptFailed(transfer->error(), transfer->errorString());
+	return;
+    }
+
+    // in case the slave passed an error page through anyway; its validators
+    // are no use to us either
+    int responseCode = transferJob->queryMetaData(QLatin1String("responsecode")).toInt();
+    if (transferJob->isErrorPage() || responseCode >= 400) {
+	attemptFailed(KIO::ERR_INTERNAL_SERVER, KIO::buildErrorString(KIO::ERR_INTERNAL_SERVER, m_url.host()));
+	return;
+    }
+
+    // remember how to ask for this page conditionally next time
+    RtdFetchScheduler::Validator validator;
+    foreach (const QString& header, transferJob->queryMetaData(QLatin1String("HTTP-Headers")).split('\n')) {
+	int colon = header.indexOf(':');
+	if (colon < 0)
+	    continue;
+	QString name = header.left(colon).trimmed().toLower();
+	if (name == QLatin1String("etag"))
+	    validator.etag = header.mid(colon + 1).trimmed();
+	else if (name == QLatin1String("last-modified"))
+	    validator.lastModified = header.mid(colon + 1).trimmed();
+    }
+    if (!validator.etag.isEmpty() || !validator.lastModified.isEmpty())
+	m_scheduler->m_validators.insert(m_url.url(), validator);
+
+    finish(0, QString());
+}
+
+void RtdFetchJob::attemptTimedOut()
+{
+    if (!m_transfer)
+	return;
+
+    // killing the transfer quietly means we won't hear from it again
+    m_transfer->kill();
+    m_transfer = 0;
+    m_scheduler->transferFinished();
+
+    attemptFailed(KIO::ERR_SERVER_TIMEOUT, KIO::buildErrorString(KIO::ERR_SERVER_TIMEOUT, m_url.host()));
+}
+
+void RtdFetchJob::attemptFailed(int error, const QString& errorText)
+{
+    if (m_attempts >= MAX_ATTEMPTS) {
+	finish(error, errorText);
+	return;
+    }
+
+    // back off: 2, 4, 8... seconds
+    m_scheduler->m_retries++;
+    QTimer::singleShot(RETRY_DELAY << (m_attempts - 1), this, SLOT(retry()));
+}
+
+void RtdFetchJob::retry()
+{
+    if (!m_finished)
+	m_scheduler->enqueue(this);
+}
+
+void RtdFetchJob::deadlineExpired()
+{
+    if (m_finished)
+	return;
+
+    // we may be on the network, in the queue, or waiting out a backoff
+    if (m_transfer) {
+	m_transfer->kill();
+	m_transfer = 0;
+	m_scheduler->transferFinished();
+    } else {
+	m_scheduler->forget(this, false);
+    }
+
+    finish(KIO::ERR_SERVER_TIMEOUT, KIO::buildErrorString(KIO::ERR_SERVER_TIMEOUT, m_url.host()));
+}
+
+void RtdFetchJob::finish(int error, const QString& errorText)
+{
+    m_finished = true;
+    m_attemptTimer.stop();
+    m_deadlineTimer.stop();
+    m_queueTimer.stop();
+
+    setError(error);
+    setErrorText(errorText);
+    emitResult();
+}
+
+RtdFetchScheduler::RtdFetchScheduler(int maxRunning)
+    : m_maxRunning(maxRunning),
+      m_running(0),
+      m_retries(0)
+{
+}
+
+void RtdFetchScheduler::setMaxRunning(int maxRunning)
+{
+    m_maxRunning = qMax(1, maxRunning);
+    startNext();
+}
+
+int RtdFetchScheduler::queued() const
+{
+    int count = 0;
+    for (int i = 0; i < RtdFetchJob::PriorityCount; i++)
+	count += m_queues[i].size();
+    return count;
+}
+
+bool RtdFetchScheduler::loadValidators(const QString& fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+	return false;
+
+    QDataStream in(&file);
+
+    qint32 version;
+    in >> version;
+    if (version != VALIDATORS_FORMAT_VERSION)
+	return false;
+
+    while (!in.atEnd()) {
+	QString url;
+	Validator validator;
+	in >> url >> validator.etag >> validator.lastModified;
+	m_validators.insert(url, validator);
+    }
+
+    return true;
+}
+
+void RtdFetchScheduler::saveValidators(const QString& fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+	return;
+
+    QDataStream out(&file);
+    out << qint32(VALIDATORS_FORMAT_VERSION);
+    for (QHash<QString, Validator>::const_iterator it = m_validators.constBegin(); it != m_validators.constEnd(); it++)
+	out << it.key() << it.value().etag << it.value().lastModified;
+}
+
+void RtdFetchScheduler::enqueue(RtdFetchJob *job)
+{
+    m_queues[job->priority()].append(job);
+    startNext();
+}
+
+void RtdFetchScheduler::reprioritize(RtdFetchJob *job, RtdFetchJob::Priority oldPriority)
+{
+    if (m_queues[oldPriority].removeOne(job))
+	m_queues[job->priority()].append(job);
+}
+
+void RtdFetchScheduler::transferFinished()
+{
+    m_running--;
+    startNext();
+}
+
+// a job is going away without finishing: don't start anything in its place,
+// since that only happens when the engine is shutting down
+void RtdFetchScheduler::forget(RtdFetchJob *job, bool running)
+{
+    if (running)
+	m_running--;
+    else
+	m_queues[job->priority()].removeOne(job);
+}
+
+void RtdFetchScheduler::startNext()
+{
+    for (int i = 0; i < RtdFetchJob::PriorityCount && m_running < m_maxRunning; i++) {
+	while (!m_queues[i].isEmpty() && m_running < m_maxRunning) {
+	    m_running++;
+	    m_queues[i].takeFirst()->startTransfer();
+	}
+    }
+}
+
+#include "rtdfetchjob.moc"
@@ -0,0 +1,154 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RTDFETCHJOB_H
+#define RTDFETCHJOB_H
+
+#include <KDE/KJob>
+#include <KDE/KUrl>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QString>
+#include <QtCore/QTimer>
+
+namespace KIO { class Job; class TransferJob; };
+
+class RtdFetchScheduler;
+
+// One page to download from RTD. The job doesn't go to the network as soon as
+// it is started: it waits in its scheduler's queue until there's a free slot,
+// gives up on any one attempt that takes too long, and retries failed attempts
+// with exponential backoff. Once it first gets to the network, it emits
+// result() before its deadline passes; a job that someone is waiting on also
+// gives up if it can't get out of the queue in time.
+//
+// A conditional job sends the validators that the scheduler remembers from the
+// last time the page was downloaded; if the server says the page hasn't
+// changed, the job succeeds without any data and isNotModified() is true.
+class RtdFetchJob : public KJob
+{
+    Q_OBJECT
+
+    public:
+	// the order in which queued jobs get to the network
+	enum Priority {
+	    UserPriority,           // a source that someone is looking at is waiting
+	    ValidityPriority,       // checking whether our schedules are still current
+	    PrefetchPriority,       // nobody is waiting for it yet
+	    PriorityCount
+	};
+
+	RtdFetchJob(RtdFetchScheduler *scheduler, const KUrl& url, Priority priority);
+	~RtdFetchJob();
+
+	void start();
+
+	KUrl url() const { return m_url; }
+	Priority priority() const { return m_priority; }
+	void raisePriority(Priority priority);
+
+	// these must be set before the job is started
+	void setConditional(bool conditional) { m_conditional = conditional; }
+	void setStreaming(bool streaming) { m_streaming = streaming; }
+	bool isNotModified() const { return m_notModified; }
+
+	// the page, once the job has succeeded; a streaming job hands out the
+	// page as it arrives with pageData() instead
+	QByteArray data() const { return m_data; }
+
+	// how many bytes came off the network, over all of the attempts
+	qint64 bytesReceived() const { return m_bytesReceived; }
+	int attempts() const { return m_attempts; }
+
+    signals:
+	void pageData(RtdFetchJob *job, const QByteArray& data);
+	void pageRestarted(RtdFetchJob *job);
+
+    private slots:
+	void transferData(KIO::Job *transfer, const QByteArray& data);
+	void transferTotalSize(KJob *transfer, qulonglong size);
+	void transferResult(KJob *transfer);
+	void attemptTimedOut();
+	void deadlineExpired();
+	void retry();
+
+    private:
+	friend class RtdFetchScheduler;
+	void startTransfer();
+	void attemptFailed(int error, const QString& errorText);
+	void finish(int error, const QString& errorText);
+
+	RtdFetchScheduler *m_scheduler;
+	KUrl m_url;
+	Priority m_priority;
+	KIO::TransferJob *m_transfer;
+	QByteArray m_data;
+	qint64 m_bytesReceived;
+	int m_attempts;
+	bool m_conditional;
+	bool m_streaming;
+	bool m_notModified;
+	bool m_finished;
+	QTimer m_attemptTimer;
+	QTimer m_deadlineTimer;
+	QTimer m_queueTimer;
+};
+
+// Hands out a bounded number of network slots to RtdFetchJobs, taking the
+// queued jobs in priority order and first come, first served within a priority.
+class RtdFetchScheduler
+{
+    public:
+	explicit RtdFetchScheduler(int maxRunning);
+
+	void setMaxRunning(int maxRunning);
+	int running() const { return m_running; }
+	int queued() const;
+
+	// how many failed attempts have been tried again, over all of the jobs
+	int retries() const { return m_retries; }
+
+	// the HTTP validators of each page we've downloaded, kept across sessions
+	bool loadValidators(const QString& fileName);
+	void saveValidators(const QString& fileName) const;
+
+    private:
+	struct Validator {
+	    QString etag;
+	    QString lastModified;
+	};
+
+	friend class RtdFetchJob;
+	void enqueue(RtdFetchJob *job);
+	void reprioritize(RtdFetchJob *job, RtdFetchJob::Priority oldPriority);
+	void transferFinished();
+	void forget(RtdFetchJob *job, bool running);
+	void startNext();
+
+	QList<RtdFetchJob *> m_queues[RtdFetchJob::PriorityCount];
+	int m_maxRunning;
+	int m_running;
+	int m_retries;
+
+	QHash<QString, Validator> m_validators;
+};
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "rtdinterntable.h"
+
+quint32 RtdInternTable::intern(const QString& s)
+{
+    QHash<QString, quint32>::const_iterator it = m_ids.constFind(s);
+    if (it != m_ids.constEnd())
+	return it.value();
+
+    quint32 id = m_strings.size();
+    m_ids.insert(s, id);
+    m_strings.append(s);
+    return id;
+}
+
+quint32 RtdInternTable::find(const QString& s) const
+{
+    return m_ids.value(s, quint32(NoId));
+}
+
+void RtdInternTable::clear()
+{
+    m_ids.clear();
+    m_strings.clear();
+}
@@ -0,0 +1,56 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RTDINTERNTABLE_H
+#define RTDINTERNTABLE_H
+
+#include <QtCore/QHash>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+// Compact ids for the names the engine keeps by the thousand: routes, stations
+// and subroutes. Ids are handed out densely from 0 and never change, so they
+// can be kept in place of the text and compared as plain integers; the text
+// only comes back out when results are published. The timetable store saves
+// the table along with the timetables that use it.
+//
+// The table belongs to the Plasma main thread.
+class RtdInternTable
+{
+    public:
+	enum { NoId = 0xffffffff };
+
+	// the id of @p s, giving it a new one if need be
+	quint32 intern(const QString& s);
+
+	// the id of @p s, or NoId if it hasn't got one
+	quint32 find(const QString& s) const;
+
+	const QString& string(quint32 id) const { return m_strings[id]; }
+	int count() const { return m_strings.size(); }
+
+	// forget every id, for when nothing refers to them any more
+	void clear();
+
+    private:
+	QHash<QString, quint32> m_ids;
+	QStringList m_strings;
+};
+
+#endif
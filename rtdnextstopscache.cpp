@@ -0,0 +1,125 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "rtdnextstopscache.h"
+
+RtdNextStopsCache::RtdNextStopsCache(int maxEntries, int maxBytes)
+    : m_maxEntries(maxEntries),
+      m_maxBytes(maxBytes),
+      m_bytes(0),
+      m_hits(0),
+      m_misses(0)
+{
+}
+
+void RtdNextStopsCache::setLimits(int maxEntries, int maxBytes)
+{
+    m_maxEntries = maxEntries;
+    m_maxBytes = maxBytes;
+    trim();
+}
+
+// the same stops asked for in a different order are the same query
+QString RtdNextStopsCache::stopSet(const QStringList& routes)
+{
+    QStringList canonical = routes;
+    qSort(canonical);
+
+    QString ret;
+    QString previous;
+    for (int i = 0; i < canonical.size(); i++) {
+	if (i > 0 && canonical[i] == previous)
+	    continue;
+	ret += canonical[i];
+	ret += QLatin1Char(',');
+	previous = canonical[i];
+    }
+
+    return ret;
+}
+
+QString RtdNextStopsCache::key(const QString& stopSet, const QDate& date)
+{
+    return stopSet + date.toString(Qt::ISODate);
+}
+
+bool RtdNextStopsCache::find(const QString& key, StopTimetables *timetables)
+{
+    QHash<QString, Entry>::iterator it = m_entries.find(key);
+    if (it == m_entries.end()) {
+	m_misses++;
+	return false;
+    }
+
+    // move it to the front of the line
+    m_lru.erase(it.value().lru);
+    m_lru.prepend(key);
+    it.value().lru = m_lru.begin();
+
+    *timetables = it.value().timetables;
+    m_hits++;
+    return true;
+}
+
+void RtdNextStopsCache::insert(const QString& key, const StopTimetables& timetables)
+{
+    QHash<QString, Entry>::iterator it = m_entries.find(key);
+    if (it != m_entries.end()) {
+	m_bytes -= it.value().cost;
+	m_lru.erase(it.value().lru);
+	m_entries.erase(it);
+    }
+
+    Entry entry;
+    entry.timetables = timetables;
+    entry.cost = cost(key, timetables);
+    m_lru.prepend(key);
+    entry.lru = m_lru.begin();
+
+    m_entries.insert(key, entry);
+    m_bytes += entry.cost;
+
+    trim();
+}
+
+void RtdNextStopsCache::clear()
+{
+    m_entries.clear();
+    m_lru.clear();
+    m_bytes = 0;
+}
+
+// a rough idea of how much memory an entry takes up
+int RtdNextStopsCache::cost(const QString& key, const StopTimetables& timetables)
+{
+    int ret = sizeof(Entry) + key.length() * sizeof(QChar);
+    foreach (const StopTimetable& timetable, timetables)
+	ret += sizeof(StopTimetable) + timetable.count() * (sizeof(int) + sizeof(quint32));
+    return ret;
+}
+
+// throw out the least recently used entries until we're within bounds
+void RtdNextStopsCache::trim()
+{
+    while (!m_lru.isEmpty() && (m_entries.size() > m_maxEntries || m_bytes > m_maxBytes)) {
+	QString key = m_lru.takeLast();
+	m_bytes -= m_entries.value(key).cost;
+	m_entries.remove(key);
+    }
+}
@@ -0,0 +1,73 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RTDNEXTSTOPSCACHE_H
+#define RTDNEXTSTOPSCACHE_H
+
+#include <QtCore/QDate>
+#include <QtCore/QHash>
+#include <QtCore/QLinkedList>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+#include "rtddepartures.h"
+
+// A least-recently-used cache of the timetables behind NextStops queries, keyed
+// by the set of route:stop pairs and the service date. It is bounded both by
+// the number of entries and by an estimate of the memory they take up.
+class RtdNextStopsCache
+{
+    public:
+	RtdNextStopsCache(int maxEntries, int maxBytes);
+
+	void setLimits(int maxEntries, int maxBytes);
+
+	// the route:stop pairs in a canonical order, and the key of those on @p date
+	static QString stopSet(const QStringList& routes);
+	static QString key(const QString& stopSet, const QDate& date);
+
+	bool find(const QString& key, StopTimetables *timetables);
+	void insert(const QString& key, const StopTimetables& timetables);
+	void clear();
+
+	int count() const { return m_entries.size(); }
+	int bytes() const { return m_bytes; }
+	int hits() const { return m_hits; }
+	int misses() const { return m_misses; }
+
+    private:
+	struct Entry {
+	    StopTimetables timetables;
+	    int cost;
+	    QLinkedList<QString>::iterator lru;
+	};
+
+	static int cost(const QString& key, const StopTimetables& timetables);
+	void trim();
+
+	QHash<QString, Entry> m_entries;
+	QLinkedList<QString> m_lru;     // most recently used first
+	int m_maxEntries;
+	int m_maxBytes;
+	int m_bytes;
+	int m_hits;
+	int m_misses;
+};
+
+#endif
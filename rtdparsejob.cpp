@@ -0,0 +1,124 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "rtdparsejob.h"
+
+#include <QtCore/QThreadPool>
+
+#include "rtdstats.h"
+
+RtdParseJob::RtdParseJob(const RtdDenverEngine *engine, QThreadPool *pool, KJob *job,
+			 const QString& routeName, int direction, const QDate& validAsOf)
+    : m_engine(engine),
+      m_pool(pool),
+      m_job(job),
+      m_routeName(routeName),
+      m_direction(direction),
+      m_validAsOf(validAsOf),
+      m_scheduled(false),
+      m_finished(false),
+      m_abandoned(false),
+      m_parser(routeName),
+      m_hasTimetable(false),
+      m_parseTime(0),
+      m_parseStarted(0),
+      m_parseFinished(0)
+{
+    setAutoDelete(false);
+}
+
+void RtdParseJob::addData(const QByteArray& data)
+{
+    QMutexLocker locker(&m_mutex);
+    m_chunks.append(data);
+    schedule();
+}
+
+void RtdParseJob::restart()
+{
+    QMutexLocker locker(&m_mutex);
+    m_chunks.append(QByteArray());
+    schedule();
+}
+
+void RtdParseJob::finish()
+{
+    QMutexLocker locker(&m_mutex);
+    m_finished = true;
+    schedule();
+}
+
+void RtdParseJob::abandon()
+{
+    QMutexLocker locker(&m_mutex);
+    m_chunks.clear();
+    m_abandoned = true;
+    m_finished = true;
+    schedule();
+}
+
+// put us on the pool, unless a worker is already on the case; the mutex must be held
+void RtdParseJob::schedule()
+{
+    if (m_scheduled)
+	return;
+
+    m_scheduled = true;
+    m_pool->start(this);
+}
+
+void RtdParseJob::run()
+{
+    forever {
+	m_mutex.lock();
+	if (m_chunks.isEmpty()) {
+	    bool finished = m_finished;
+	    m_scheduled = finished;     // once we're finished, nobody needs to start us again
+	    m_mutex.unlock();
+	    if (!finished)
+		return;
+	    break;
+	}
+	QByteArray chunk = m_chunks.takeFirst();
+	m_mutex.unlock();
+
+	qint64 start = rtdMonotonicMicros();
+	if (!m_parseStarted)
+	    m_parseStarted = start;
+	if (chunk.isNull())
+	    m_parser = RtdScheduleParser(m_routeName);
+	else
+	    m_parser.addData(chunk);
+	m_parseTime += rtdMonotonicMicros() - start;
+    }
+
+    if (!m_abandoned) {
+	qint64 start = rtdMonotonicMicros();
+	m_page = m_parser.result();
+	m_hasTimetable = m_engine->placeSchedule(m_routeName, m_page, &m_direction, &m_validAsOf);
+	m_parseTime += rtdMonotonicMicros() - start;
+    }
+
+    m_parseFinished = rtdMonotonicMicros();
+    if (!m_parseStarted)
+	m_parseStarted = m_parseFinished;
+    emit parsed(this);
+}
+
+#include "rtdparsejob.moc"
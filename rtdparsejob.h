@@ -0,0 +1,105 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RTDPARSEJOB_H
+#define RTDPARSEJOB_H
+
+#include "rtddenverengine.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDate>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QRunnable>
+#include <QtCore/QString>
+
+#include "rtdschedule.h"
+#include "rtdscheduleparser.h"
+
+class KJob;
+class QThreadPool;
+
+// Parses one schedule page as it downloads and packs it for the timetable
+// store, on the engine's worker threads. Chunks are queued from the Plasma main
+// thread and consumed in order by at most one worker at a time, so parsing
+// overlaps the transfer and the raw page is never kept around in one piece.
+// Once the page is finished, the job is handed back to the engine with a
+// queued signal; the engine deletes it once it has filed the results.
+class RtdParseJob : public QObject, public QRunnable
+{
+    Q_OBJECT
+
+    public:
+	RtdParseJob(const RtdDenverEngine *engine, QThreadPool *pool, KJob *job,
+		    const QString& routeName, int direction, const QDate& validAsOf);
+
+	// these are called from the main thread
+	void addData(const QByteArray& data);
+	void restart();         // the download is starting over: forget what we've seen
+	void finish();          // that was all of the page
+	void abandon();         // the download failed: just hand the job back
+
+	void run();
+
+	KJob *job() const { return m_job; }
+	bool isAbandoned() const { return m_abandoned; }
+	const RtdSchedulePage& page() const { return m_page; }
+
+	// where the timetable belongs, if the page had one for us
+	bool hasTimetable() const { return m_hasTimetable; }
+	int direction() const { return m_direction; }
+	QDate validAsOf() const { return m_validAsOf; }
+	const RtdSchedule& timetable() const { return m_page.schedule; }
+
+	// microseconds the workers spent parsing the page, over all of its chunks,
+	// and when they started and finished on it, by rtdMonotonicMicros()
+	qint64 parseTime() const { return m_parseTime; }
+	qint64 parseStarted() const { return m_parseStarted; }
+	qint64 parseFinished() const { return m_parseFinished; }
+
+    signals:
+	void parsed(RtdParseJob *job);
+
+    private:
+	void schedule();
+
+	const RtdDenverEngine *m_engine;
+	QThreadPool *m_pool;
+	KJob *m_job;
+	QString m_routeName;
+	int m_direction;
+	QDate m_validAsOf;
+
+	// shared with the worker: a null chunk means "start over"
+	QMutex m_mutex;
+	QList<QByteArray> m_chunks;
+	bool m_scheduled;
+	bool m_finished;
+	bool m_abandoned;
+
+	RtdScheduleParser m_parser;
+	RtdSchedulePage m_page;
+	bool m_hasTimetable;
+	qint64 m_parseTime;
+	qint64 m_parseStarted;
+	qint64 m_parseFinished;
+};
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "rtdquery.h"
+
+#include <QtCore/QSet>
+
+#include <KDE/KLocale>
+
+#include "rtdinterntable.h"
+#include "rtdnextstopscache.h"
+
+int directionFromCode(const QString& directionCode)
+{
+    if (directionCode == QLatin1String("N"))
+	return 'N';
+    else if (directionCode == QLatin1String("S"))
+	return 'S';
+    else if (directionCode == QLatin1String("E"))
+	return 'E';
+    else if (directionCode == QLatin1String("W"))
+	return 'W';
+    else if (directionCode == QLatin1String("?"))
+	return '?';
+    else if (directionCode == QLatin1String("CW"))
+	return 'C';
+    else if (directionCode == QLatin1String("CCW"))
+	return 'c';
+    else if (directionCode == QLatin1String("Loop"))
+	return 'L';
+    return 0;
+}
+
+// split "routeName-directionCode" into @p stop
+static bool parseRoute(const QString& fullRouteName, RtdQuery::Stop *stop)
+{
+    int hyphenPos = fullRouteName.indexOf('-');
+    if (hyphenPos <= 0 || fullRouteName.indexOf('-', hyphenPos + 1) >= 0)
+	return false;
+
+    stop->fullRouteName = fullRouteName;
+    stop->routeName = fullRouteName.left(hyphenPos);
+    stop->direction = directionFromCode(fullRouteName.mid(hyphenPos + 1));
+    stop->routeId = RtdInternTable::NoId;
+    stop->stationId = RtdInternTable::NoId;
+    return stop->direction != 0;
+}
+
+RtdQuery RtdQuery::compile(const QString& sourceName)
+{
+    RtdQuery query;
+
+    if (sourceName.startsWith(QLatin1String("ScheduleOf "))) {
+	query.textForm = sourceName.endsWith(QLatin1String(" TEXT"));
+	QString fullRouteName = sourceName.mid(11, sourceName.length() - (query.textForm ? 11+5 : 11));
+
+	Stop stop;
+	if (!parseRoute(fullRouteName, &stop)) {
+	    query.error = i18n("\"%1\" is not a route and direction, like \"15-E\"", fullRouteName);
+	    return query;
+	}
+	query.stops << stop;
+	query.kind = ScheduleOf;
+	return query;
+    }
+
+    if (!sourceName.startsWith(QLatin1String("NextStops ["))) {
+	query.error = i18n("Unknown source");
+	return query;
+    }
+
+    // "NextStops [routeName1-direction1:stopName1,...] N TEXT?"
+    int lastBracket = sourceName.indexOf(']');
+    if (lastBracket < 0) {
+	query.error = i18n("The list of stops has no closing bracket");
+	return query;
+    }
+
+    // a stop listed twice is only looked up once, just as it only counts once
+    // in the stop set the NextStops cache files the timetables under
+    QStringList routes = sourceName.mid(11, lastBracket - 11).split(',');
+    QSet<QString> seen;
+    foreach (const QString& route, routes) {
+	if (seen.contains(route))
+	    continue;
+	seen.insert(route);
+
+	int colon = route.indexOf(':');
+	Stop stop;
+	if (colon < 0 || !parseRoute(route.left(colon), &stop) || colon + 1 >= route.length()) {
+	    query.error = i18n("\"%1\" is not a route, direction and stop, like \"15-E:Colfax & Broadway\"", route);
+	    return query;
+	}
+	stop.station = route.mid(colon + 1);
+	query.stops << stop;
+    }
+
+    // then how many buses to list, and in which form
+    QStringList nAndText = sourceName.mid(lastBracket + 1).split(' ', QString::SkipEmptyParts);
+    bool ok = false;
+    if (!nAndText.isEmpty())
+	query.n = nAndText.first().toInt(&ok);
+    if (!ok || query.n <= 0 || nAndText.size() > 2 ||
+	(nAndText.size() == 2 && nAndText.last() != QLatin1String("TEXT"))) {
+	query.error = i18n("The list of stops must be followed by how many buses to list, and optionally TEXT");
+	return query;
+    }
+    query.textForm = (nAndText.size() == 2);
+
+    query.stopSet = RtdNextStopsCache::stopSet(routes);
+    query.kind = NextStops;
+    return query;
+}
+
+void RtdQuery::resolve(const RtdInternTable& names)
+{
+    for (int i = 0; i < stops.size(); i++) {
+	Stop& stop = stops[i];
+	if (stop.routeId == quint32(RtdInternTable::NoId))
+	    stop.routeId = names.find(stop.routeName);
+	if (stop.stationId == quint32(RtdInternTable::NoId) && !stop.station.isEmpty())
+	    stop.stationId = names.find(stop.station);
+    }
+}
+
+void RtdQuery::unresolve()
+{
+    for (int i = 0; i < stops.size(); i++) {
+	stops[i].routeId = RtdInternTable::NoId;
+	stops[i].stationId = RtdInternTable::NoId;
+    }
+}
@@ -0,0 +1,72 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RTDQUERY_H
+#define RTDQUERY_H
+
+#include <QtCore/QList>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+class RtdInternTable;
+
+// the direction a code like "N" or "CW" stands for, '?' for "don't know", or 0
+int directionFromCode(const QString& directionCode);
+
+// A NextStops or ScheduleOf source name, picked apart once when the source is
+// first asked for: its updates run against this instead of the name. A name
+// that doesn't parse is compiled into an Invalid query saying what is wrong
+// with it, so it only gets looked at the once.
+struct RtdQuery {
+    enum Kind {
+	Invalid,
+	NextStops,      // "NextStops [route-dir:stop,...] N" or "... N TEXT"
+	ScheduleOf      // "ScheduleOf route-dir" or "... TEXT"
+    };
+
+    // one route:stop of a NextStops query, or the route of a ScheduleOf one
+    struct Stop {
+	QString fullRouteName;  // "routeName-directionCode"
+	QString routeName;
+	int direction;
+	QString station;
+
+	// the names' ids in the intern table, or NoId until they turn up there
+	quint32 routeId;
+	quint32 stationId;
+    };
+
+    Kind kind;
+    QString error;
+    QList<Stop> stops;
+    QString stopSet;            // the stops in a canonical order, for the NextStops cache
+    int n;
+    bool textForm;
+
+    RtdQuery() : kind(Invalid), n(0), textForm(false) { }
+
+    static RtdQuery compile(const QString& sourceName);
+
+    // look up any ids that weren't known yet
+    void resolve(const RtdInternTable& names);
+    // forget the ids, when the intern table starts over
+    void unresolve();
+};
+
+#endif
@@ -0,0 +1,68 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "rtdroutelist.h"
+
+#include <QtCore/QRegExp>
+
+// sort-of parse the JavaScript data structure that the RTD website uses
+// for its schedule menu
+QHash<QString, QString> parseRtdRouteList(const QByteArray& scheduleList)
+{
+    QHash<QString, QString> routes;
+    QRegExp urlPattern("\\?(.+)$");
+
+    int nextPos = 0;
+    forever {
+	int textPos = scheduleList.indexOf("text:", nextPos);
+	if (textPos < 0)
+	    break;
+
+	int firstQPos = scheduleList.indexOf("\"", textPos+5);
+	if (firstQPos < 0)
+	    break;
+
+	int secondQPos = scheduleList.indexOf("\"", firstQPos+1);
+	if (secondQPos < 0)
+	    break;
+
+	QString routeName = QString::fromAscii(scheduleList.mid(firstQPos+1, secondQPos - firstQPos - 1));
+
+	int urlPos = scheduleList.indexOf("url:", secondQPos+1);
+	if (urlPos < 0)
+	    break;
+
+	firstQPos = scheduleList.indexOf("\"", urlPos+4);
+	if (firstQPos < 0)
+	    break;
+
+	secondQPos = scheduleList.indexOf("\"", firstQPos+1);
+	if (secondQPos < 0)
+	    break;
+
+	QString routeUrlPart = QString::fromAscii(scheduleList.mid(firstQPos+1, secondQPos - firstQPos - 1));
+	if (urlPattern.indexIn(routeUrlPart) >= 0) {
+	    routes.insert(routeName, urlPattern.cap(1));
+	}
+
+	nextPos = secondQPos+1;
+    }
+
+    return routes;
+}
@@ -0,0 +1,59 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RTDSCHEDULE_H
+#define RTDSCHEDULE_H
+
+#include <QtCore/QDate>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+// One route in one direction on one day type: the form a schedule takes from
+// the parser, through the timetable store, to the queries. Each station's
+// departures are sorted minutes since the service day began, so buses after
+// midnight count from 1440 up.
+struct RtdSchedule {
+    QStringList stations;               // sorted
+    QStringList subroutes;
+    QVector<quint32> stopStarts;        // stations.size() + 1 offsets into the arrays below
+    QVector<quint16> minutes;
+    QVector<quint16> subrouteIndexes;   // indexes into subroutes
+
+    RtdSchedule() { stopStarts.append(0); }
+};
+
+// what the parser made of one schedule page
+struct RtdSchedulePage {
+    enum Status {
+	Unreadable,     // not a schedule page we understand
+	NotFound,       // the route doesn't run on that day
+	Found
+    };
+
+    Status status;
+    QDate validAsOf;
+    QString direction;                  // the direction code of this page, e.g. "N" or "CW"
+    QString availableDirections;        // all of the route's directions, joined with '-'
+    RtdSchedule schedule;
+
+    RtdSchedulePage() : status(Unreadable) { }
+};
+
+#endif
@@ -57,8 +57,9 @@ void RtdScheduleApplet::init()
         return;
     }
 
+    // the engine pushes an update whenever a bus leaves, so there's no need to poll
     setBusy(true);
-    de->connectSource(sourceName, this, 60*1000, Plasma::AlignToMinute);
+    de->connectSource(sourceName, this);
 }
 
 void RtdScheduleApplet::dataUpdated(const QString& sourceName, const Plasma::DataEngine::Data& data)
@@ -67,6 +68,11 @@ void RtdScheduleApplet::dataUpdated(const QString& sourceName, const Plasma::Dat
         return;
 
     setBusy(false);
+    if (data.contains(QLatin1String("Error"))) {
+        m_label->setText(i18n("Cannot load the bus schedule: %1", data[QLatin1String("Error")].toString()));
+        return;
+    }
+
     QList<DateTimeRoutePair> stops = data[sourceName].value< QList<DateTimeRoutePair> >();
 
     QString text = QLatin1String("<html><body style='background-color: transparent;'>"
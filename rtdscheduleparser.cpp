@@ -0,0 +1,819 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "rtdscheduleparser.h"
+
+#include <QtCore/QDate>
+#include <QtCore/QPair>
+#include <QtCore/QRegExp>
+#include <QtCore/QtAlgorithms>
+
+static const char *const cellNames[] = { "td", "th", 0 };
+static const char *const cellBoundaries[] = { "tr", "table", 0 };
+static const char *const rowNames[] = { "tr", 0 };
+static const char *const rowBoundaries[] = { "table", 0 };
+static const char *const paragraphNames[] = { "p", 0 };
+static const char *const paragraphBoundaries[] = { "div", "td", "th", "table", 0 };
+
+static bool isVoidElement(const QByteArray& name)
+{
+    return name == "br" || name == "img" || name == "input" || name == "meta" ||
+	   name == "link" || name == "hr" || name == "area" || name == "base" ||
+	   name == "col" || name == "embed" || name == "param";
+}
+
+static bool isNameChar(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+	   c == '-' || c == '_' || c == ':';
+}
+
+static bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+static bool nameIn(const QByteArray& name, const char *const *names)
+{
+    for (; *names; names++) {
+	if (name == *names)
+	    return true;
+    }
+    return false;
+}
+
+// find the start of "</name" at or after @p from, ignoring case
+static int indexOfEndTag(const QByteArray& html, int from, const QByteArray& name)
+{
+    int pos = from;
+    forever {
+	pos = html.indexOf("</", pos);
+	if (pos < 0)
+	    return -1;
+	if (qstrnicmp(html.constData() + pos + 2, name.constData(), name.length()) == 0)
+	    return pos;
+	pos += 2;
+    }
+}
+
+// scan the attributes of a start tag, from just after its name at @p i up to
+// the '>' that ends it, picking out its class; a quote only counts around an
+// attribute's value, as in html. Returns the position of the '>', or the length
+// of @p html if the tag runs off the end of it
+static int scanAttributes(const QByteArray& html, int i, QByteArray *cls, bool *selfClosing)
+{
+    const int length = html.length();
+    const char *data = html.constData();
+
+    while (i < length && data[i] != '>') {
+	if (isSpace(data[i])) {
+	    i++;
+	    continue;
+	}
+	if (data[i] == '/') {
+	    if (selfClosing)
+		*selfClosing = (i + 1 < length && data[i + 1] == '>');
+	    i++;
+	    continue;
+	}
+
+	int attrStart = i;
+	while (i < length && !isSpace(data[i]) && data[i] != '=' && data[i] != '>' && data[i] != '/')
+	    i++;
+	int attrEnd = i;
+	while (i < length && isSpace(data[i]))
+	    i++;
+
+	int valueStart = i, valueEnd = i;
+	if (i < length && data[i] == '=') {
+	    i++;
+	    while (i < length && isSpace(data[i]))
+		i++;
+	    if (i < length && (data[i] == '"' || data[i] == '\'')) {
+		char quote = data[i];
+		valueStart = i + 1;
+		valueEnd = html.indexOf(quote, valueStart);
+		if (valueEnd < 0)
+		    return length;
+		i = valueEnd + 1;
+	    } else {
+		valueStart = i;
+		while (i < length && !isSpace(data[i]) && data[i] != '>')
+		    i++;
+		valueEnd = i;
+	    }
+	}
+
+	if (cls && attrEnd - attrStart == 5 && qstrnicmp(data + attrStart, "class", 5) == 0)
+	    *cls = html.mid(valueStart, valueEnd - valueStart);
+	if (selfClosing)
+	    *selfClosing = false;
+    }
+
+    return i;
+}
+
+// the character entities of html 4, sorted for a binary search
+static const struct {
+    const char *name;
+    ushort code;
+} htmlEntities[] = {
+    { "AElig", 198 }, { "Aacute", 193 }, { "Acirc", 194 }, { "Agrave", 192 }, { "Alpha", 913 },
+    { "Aring", 197 }, { "Atilde", 195 }, { "Auml", 196 }, { "Beta", 914 }, { "Ccedil", 199 },
+    { "Chi", 935 }, { "Dagger", 8225 }, { "Delta", 916 }, { "ETH", 208 }, { "Eacute", 201 },
+    { "Ecirc", 202 }, { "Egrave", 200 }, { "Epsilon", 917 }, { "Eta", 919 }, { "Euml", 203 },
+    { "Gamma", 915 }, { "Iacute", 205 }, { "Icirc", 206 }, { "Igrave", 204 }, { "Iota", 921 },
+    { "Iuml", 207 }, { "Kappa", 922 }, { "Lambda", 923 }, { "Mu", 924 }, { "Ntilde", 209 },
+    { "Nu", 925 }, { "OElig", 338 }, { "Oacute", 211 }, { "Ocirc", 212 }, { "Ograve", 210 },
+    { "Omega", 937 }, { "Omicron", 927 }, { "Oslash", 216 }, { "Otilde", 213 }, { "Ouml", 214 },
+    { "Phi", 934 }, { "Pi", 928 }, { "Prime", 8243 }, { "Psi", 936 }, { "Rho", 929 },
+    { "Scaron", 352 }, { "Sigma", 931 }, { "THORN", 222 }, { "Tau", 932 }, { "Theta", 920 },
+    { "Uacute", 218 }, { "Ucirc", 219 }, { "Ugrave", 217 }, { "Upsilon", 933 }, { "Uuml", 220 },
+    { "Xi", 926 }, { "Yacute", 221 }, { "Yuml", 376 }, { "Zeta", 918 }, { "aacute", 225 },
+    { "acirc", 226 }, { "acute", 180 }, { "aelig", 230 }, { "agrave", 224 }, { "alefsym", 8501 },
+    { "alpha", 945 }, { "amp", 38 }, { "and", 8743 }, { "ang", 8736 }, { "aring", 229 },
+    { "asymp", 8776 }, { "atilde", 227 }, { "auml", 228 }, { "bdquo", 8222 }, { "beta", 946 },
+    { "brvbar", 166 }, { "bull", 8226 }, { "cap", 8745 }, { "ccedil", 231 }, { "cedil", 184 },
+    { "cent", 162 }, { "chi", 967 }, { "circ", 710 }, { "clubs", 9827 }, { "cong", 8773 },
+    { "copy", 169 }, { "crarr", 8629 }, { "cup", 8746 }, { "curren", 164 }, { "dArr", 8659 },
+    { "dagger", 8224 }, { "darr", 8595 }, { "deg", 176 }, { "delta", 948 }, { "diams", 9830 },
+    { "divide", 247 }, { "eacute", 233 }, { "ecirc", 234 }, { "egrave", 232 }, { "empty", 8709 },
+    { "emsp", 8195 }, { "ensp", 8194 }, { "epsilon", 949 }, { "equiv", 8801 }, { "eta", 951 },
+    { "eth", 240 }, { "euml", 235 }, { "euro", 8364 }, { "exist", 8707 }, { "fnof", 402 },
+    { "forall", 8704 }, { "frac12", 189 }, { "frac14", 188 }, { "frac34", 190 }, { "frasl", 8260 },
+    { "gamma", 947 }, { "ge", 8805 }, { "gt", 62 }, { "hArr", 8660 }, { "harr", 8596 },
+    { "hearts", 9829 }, { "hellip", 8230 }, { "iacute", 237 }, { "icirc", 238 }, { "iexcl", 161 },
+    { "igrave", 236 }, { "image", 8465 }, { "infin", 8734 }, { "int", 8747 }, { "iota", 953 },
+    { "iquest", 191 }, { "isin", 8712 }, { "iuml", 239 }, { "kappa", 954 }, { "lArr", 8656 },
+    { "lambda", 955 }, { "lang", 9001 }, { "laquo", 171 }, { "larr", 8592 }, { "lceil", 8968 },
+    { "ldquo", 8220 }, { "le", 8804 }, { "lfloor", 8970 }, { "lowast", 8727 }, { "loz", 9674 },
+    { "lrm", 8206 }, { "lsaquo", 8249 }, { "lsquo", 8216 }, { "lt", 60 }, { "macr", 175 },
+    { "mdash", 8212 }, { "micro", 181 }, { "middot", 183 }, { "minus", 8722 }, { "mu", 956 },
+    { "nabla", 8711 }, { "nbsp", 160 }, { "ndash", 8211 }, { "ne", 8800 }, { "ni", 8715 },
+    { "not", 172 }, { "notin", 8713 }, { "nsub", 8836 }, { "ntilde", 241 }, { "nu", 957 },
+    { "oacute", 243 }, { "ocirc", 244 }, { "oelig", 339 }, { "ograve", 242 }, { "oline", 8254 },
+    { "omega", 969 }, { "omicron", 959 }, { "oplus", 8853 }, { "or", 8744 }, { "ordf", 170 },
+    { "ordm", 186 }, { "oslash", 248 }, { "otilde", 245 }, { "otimes", 8855 }, { "ouml", 246 },
+    { "para", 182 }, { "part", 8706 }, { "permil", 8240 }, { "perp", 8869 }, { "phi", 966 },
+    { "pi", 960 }, { "piv", 982 }, { "plusmn", 177 }, { "pound", 163 }, { "prime", 8242 },
+    { "prod", 8719 }, { "prop", 8733 }, { "psi", 968 }, { "quot", 34 }, { "rArr", 8658 },
+    { "radic", 8730 }, { "rang", 9002 }, { "raquo", 187 }, { "rarr", 8594 }, { "rceil", 8969 },
+    { "rdquo", 8221 }, { "real", 8476 }, { "reg", 174 }, { "rfloor", 8971 }, { "rho", 961 },
+    { "rlm", 8207 }, { "rsaquo", 8250 }, { "rsquo", 8217 }, { "sbquo", 8218 }, { "scaron", 353 },
+    { "sdot", 8901 }, { "sect", 167 }, { "shy", 173 }, { "sigma", 963 }, { "sigmaf", 962 },
+    { "sim", 8764 }, { "spades", 9824 }, { "sub", 8834 }, { "sube", 8838 }, { "sum", 8721 },
+    { "sup", 8835 }, { "sup1", 185 }, { "sup2", 178 }, { "sup3", 179 }, { "supe", 8839 },
+    { "szlig", 223 }, { "tau", 964 }, { "there4", 8756 }, { "theta", 952 }, { "thetasym", 977 },
+    { "thinsp", 8201 }, { "thorn", 254 }, { "tilde", 732 }, { "times", 215 }, { "trade", 8482 },
+    { "uArr", 8657 }, { "uacute", 250 }, { "uarr", 8593 }, { "ucirc", 251 }, { "ugrave", 249 },
+    { "uml", 168 }, { "upsih", 978 }, { "upsilon", 965 }, { "uuml", 252 }, { "weierp", 8472 },
+    { "xi", 958 }, { "yacute", 253 }, { "yen", 165 }, { "yuml", 255 }, { "zeta", 950 },
+    { "zwj", 8205 }, { "zwnj", 8204 }
+};
+
+// the character a named entity stands for, or a null QChar
+static QChar namedEntity(const QString& name)
+{
+    // not html 4, but WebKit knows it
+    if (name == QLatin1String("apos"))
+	return QChar('\'');
+
+    QByteArray latin = name.toLatin1();
+    int low = 0;
+    int high = sizeof(htmlEntities) / sizeof(htmlEntities[0]);
+    while (low < high) {
+	int mid = (low + high) / 2;
+	int c = qstrcmp(htmlEntities[mid].name, latin.constData());
+	if (c == 0)
+	    return QChar(htmlEntities[mid].code);
+	else if (c < 0)
+	    low = mid + 1;
+	else
+	    high = mid;
+    }
+    return QChar();
+}
+
+// the equivalent of a DOM node's textContent: decode the bytes and expand
+// the character entities, named or numeric
+static QString htmlText(const QByteArray& raw)
+{
+    QString text = QString::fromUtf8(raw);
+    int amp = text.indexOf('&');
+    if (amp < 0)
+	return text;
+
+    QString ret;
+    ret.reserve(text.length());
+    int pos = 0;
+    while (amp >= 0) {
+	ret += text.midRef(pos, amp - pos);
+	int semi = text.indexOf(';', amp + 1);
+	if (semi < 0 || semi - amp > 10) {
+	    ret += '&';
+	    pos = amp + 1;
+	    amp = text.indexOf('&', pos);
+	    continue;
+	}
+
+	QString entity = text.mid(amp + 1, semi - amp - 1);
+	QChar c;
+	if (entity.startsWith('#')) {
+	    bool ok;
+	    uint code = (entity.length() > 1 && (entity[1] == 'x' || entity[1] == 'X')) ?
+			entity.mid(2).toUInt(&ok, 16) : entity.mid(1).toUInt(&ok, 10);
+	    if (ok && code > 0 && code < 0x10000)
+		c = QChar(code);
+	} else {
+	    c = namedEntity(entity);
+	}
+
+	if (c.isNull()) {
+	    // not one we know: leave it alone
+	    ret += text.midRef(amp, semi - amp + 1);
+	} else {
+	    ret += c;
+	}
+	pos = semi + 1;
+	amp = text.indexOf('&', pos);
+    }
+    ret += text.midRef(pos);
+
+    return ret;
+}
+
+// RTD writes times like "1005A" or "915P"
+int RtdScheduleParser::parseTime(const QString& str)
+{
+    int hr, min;
+    int digitCount = 0;
+
+    if (str.length() < 4)
+	return -1;
+
+    for (int i = 0; i < str.length(); i++) {
+	if (str[i] < '0' || str[i] > '9')
+	    break;
+	digitCount++;
+    }
+
+    if (digitCount == 3) {
+	hr = str.left(1).toInt();
+	min = str.mid(1, 2).toInt();
+    } else if (digitCount == 4) {
+	hr = str.left(2).toInt();
+	min = str.mid(2, 2).toInt();
+    } else {
+	return -1;
+    }
+
+    if (digitCount >= str.length())
+	return -1;
+
+    if (hr == 12 && str[digitCount] == 'A')
+	hr -= 12;
+
+    if (str[digitCount] == 'P')
+	hr += 12;
+
+    if (hr > 23 || min > 59)
+	return -1;
+    return hr * 60 + min;
+}
+
+// dates like "August 23, 2009", in English whatever the locale
+QDate RtdScheduleParser::parseDate(const QString& str)
+{
+    static const char *const months[] = {
+	"January", "February", "March", "April", "May", "June", "July",
+	"August", "September", "October", "November", "December"
+    };
+
+    QRegExp date(QLatin1String("(\\w+)\\s+(\\d+),\\s+(\\d+)"));
+    if (date.indexIn(str) < 0)
+	return QDate();
+
+    for (int i = 0; i < 12; i++) {
+	if (date.cap(1) == QLatin1String(months[i]))
+	    return QDate(date.cap(3).toInt(), i + 1, date.cap(2).toInt());
+    }
+    return QDate();
+}
+
+RtdScheduleParser::RtdScheduleParser(const QString& routeName)
+    : m_routeName(routeName),
+      m_bufferPos(0),
+      m_rowDepth(-1),
+      m_headRowDepth(-1),
+      m_tableDepth(-1),
+      m_tableClosed(false),
+      m_rowFirst(true),
+      m_rowStation(0),
+      m_noService(false),
+      m_hasSubroutes(false),
+      m_subroutesProbed(false)
+{
+}
+
+RtdSchedulePage RtdScheduleParser::parse(const QByteArray& html, const QString& routeName)
+{
+    RtdScheduleParser parser(routeName);
+    parser.addData(html);
+    return parser.result();
+}
+
+void RtdScheduleParser::addData(const QByteArray& html)
+{
+    if (m_bufferPos >= m_buffer.length()) {
+	// nothing held back: scan the chunk where it is
+	m_buffer = html;
+	m_bufferPos = 0;
+    } else {
+	// only drop what we've scanned once it's most of the buffer, so that
+	// a long unfinished tag isn't copied again with every chunk
+	if (m_bufferPos > m_buffer.length() / 2) {
+	    m_buffer.remove(0, m_bufferPos);
+	    m_bufferPos = 0;
+	}
+	m_buffer += html;
+    }
+
+    m_bufferPos = feed(m_buffer, m_bufferPos, false);
+}
+
+// scan @p html from @p pos, returning where we stopped: unless this is the
+// @p last of the page, anything cut off at the end is left for the next chunk
+int RtdScheduleParser::feed(const QByteArray& html, int pos, bool last)
+{
+    const int length = html.length();
+
+    while (pos < length) {
+	int lt = html.indexOf('<', pos);
+	if (lt < 0) {
+	    if (!last)
+		return pos;
+	    lt = length;
+	}
+
+	if (lt > pos && !m_captures.isEmpty())
+	    handleText(html.constData() + pos, lt - pos);
+
+	if (lt >= length)
+	    break;
+
+	if (!last && markupEnd(html, lt) < 0)
+	    return lt;
+
+	pos = handleMarkup(html, lt);
+    }
+
+    return length;
+}
+
+// where the markup starting at @p pos ends, or -1 if it runs off the end of
+// @p html; this follows handleMarkup()'s idea of where things end
+int RtdScheduleParser::markupEnd(const QByteArray& html, int pos) const
+{
+    const int length = html.length();
+    const char *data = html.constData();
+
+    if (pos + 1 >= length)
+	return -1;
+
+    char c = data[pos + 1];
+    if (c == '!' && (pos + 4 > length || qstrncmp(data + pos, "<!--", 4) == 0)) {
+	if (pos + 4 > length)
+	    return -1;
+	int end = html.indexOf("-->", pos + 4);
+	return (end < 0 ? -1 : end + 3);
+    }
+    if (c == '!' || c == '?' || c == '/') {
+	int end = html.indexOf('>', pos + 2);
+	return (end < 0 ? -1 : end + 1);
+    }
+    if (!isNameChar(c))
+	return pos + 1;
+
+    // a start tag, where a '>' may be hiding in a quoted attribute value
+    int i = pos + 1;
+    while (i < length && isNameChar(data[i]))
+	i++;
+    QByteArray name = html.mid(pos + 1, i - pos - 1).toLower();
+
+    i = scanAttributes(html, i, 0, 0);
+    if (i >= length)
+	return -1;
+
+    // and we skip the whole of a script or style in one go
+    if (name == "script" || name == "style") {
+	int close = indexOfEndTag(html, i + 1, name);
+	if (close < 0)
+	    return -1;
+	int closeEnd = html.indexOf('>', close);
+	return (closeEnd < 0 ? -1 : closeEnd + 1);
+    }
+
+    return i + 1;
+}
+
+// handle the markup starting at @p pos (which is a '<'), returning the position
+// just past it
+int RtdScheduleParser::handleMarkup(const QByteArray& html, int pos)
+{
+    const int length = html.length();
+    const char *data = html.constData();
+
+    if (pos + 1 >= length)
+	return length;
+
+    char c = data[pos + 1];
+
+    // comments, doctypes and processing instructions
+    if (c == '!' || c == '?') {
+	int end;
+	if (qstrncmp(data + pos, "<!--", 4) == 0) {
+	    end = html.indexOf("-->", pos + 4);
+	    return (end < 0 ? length : end + 3);
+	}
+	end = html.indexOf('>', pos + 2);
+	return (end < 0 ? length : end + 1);
+    }
+
+    // end tags
+    if (c == '/') {
+	int nameStart = pos + 2;
+	int nameEnd = nameStart;
+	while (nameEnd < length && isNameChar(data[nameEnd]))
+	    nameEnd++;
+	int end = html.indexOf('>', nameEnd);
+	if (nameEnd > nameStart)
+	    handleEndTag(html.mid(nameStart, nameEnd - nameStart).toLower());
+	return (end < 0 ? length : end + 1);
+    }
+
+    // a bare '<' in the text
+    if (!isNameChar(c)) {
+	if (!m_captures.isEmpty())
+	    handleText(data + pos, 1);
+	return pos + 1;
+    }
+
+    // start tags: all we care about is the name and the class attribute
+    int nameStart = pos + 1;
+    int i = nameStart;
+    while (i < length && isNameChar(data[i]))
+	i++;
+    QByteArray name = html.mid(nameStart, i - nameStart).toLower();
+    QByteArray cls;
+    bool selfClosing = false;
+    i = scanAttributes(html, i, &cls, &selfClosing);
+    int end = (i < length ? i + 1 : length);
+
+    handleStartTag(name, cls, selfClosing);
+
+    // skip over the contents of elements that can't contain markup
+    if (!selfClosing && (name == "script" || name == "style")) {
+	int close = indexOfEndTag(html, end, name);
+	if (close < 0)
+	    return length;
+	int closeEnd = html.indexOf('>', close);
+	handleEndTag(name);
+	return (closeEnd < 0 ? length : closeEnd + 1);
+    }
+
+    return end;
+}
+
+void RtdScheduleParser::handleText(const char *text, int length)
+{
+    for (int i = 0; i < m_captures.size(); i++) {
+	Capture& capture = m_captures[i];
+	if (capture.role == SubrouteProbeCapture) {
+	    // we only want the first text node directly inside the element
+	    if (!capture.done && capture.depth == m_stack.size()) {
+		capture.text = QByteArray(text, length);
+		capture.done = true;
+	    }
+	} else {
+	    capture.text.append(text, length);
+	}
+    }
+}
+
+void RtdScheduleParser::handleStartTag(const QByteArray& name, const QByteArray& cls, bool selfClosing)
+{
+    // a link inside a direction header means that it's the _other_ direction
+    if (name == "a") {
+	for (int i = 0; i < m_captures.size(); i++) {
+	    if (m_captures[i].role == DirectionCapture)
+		m_captures[i].hasLink = true;
+	}
+    }
+
+    if (selfClosing || isVoidElement(name))
+	return;
+
+    // RTD's html leaves plenty of elements unclosed: do just enough of the
+    // html implied-end-tag dance to keep our stack sane
+    if (name == "td" || name == "th")
+	closeImplied(cellNames, cellBoundaries);
+    else if (name == "tr")
+	closeImplied(rowNames, rowBoundaries);
+    else if (name == "p")
+	closeImplied(paragraphNames, paragraphBoundaries);
+
+    m_stack.append(Element(name));
+
+    if (name == "p") {
+	if (cls == "bodyBlueHeadline" && m_validAsOf.isEmpty())
+	    startCapture(ValidityCapture);
+	else if (cls == "bodyText" && m_validAsOf.isEmpty() && !m_noService)
+	    startCapture(NoServiceCapture);     // a schedule page has its headline first
+    } else if (name == "table") {
+	if (cls == "schedule" && m_tableDepth < 0 && !m_tableClosed)
+	    m_tableDepth = m_stack.size() - 1;
+    } else if (name == "td") {
+	if (cls == "scheduleHeaderBlueHilite")
+	    startCapture(DirectionCapture);
+	if (m_rowDepth >= 0)
+	    startCapture(CellCapture);
+    } else if (name == "div") {
+	if (cls == "scheduleStations")
+	    startCapture(StationCapture);
+	else if (cls == "scheduleTimesGrey" && m_headRowDepth >= 0 && !m_subroutesProbed)
+	    startCapture(SubrouteProbeCapture);
+    } else if (name == "tr") {
+	if (cls == "row") {
+	    m_rowDepth = m_stack.size() - 1;
+	    m_rowFirst = true;
+	    m_rowStation = 0;
+	    m_rowSubroute.clear();
+	} else if (cls == "headrow") {
+	    m_headRowDepth = m_stack.size() - 1;
+	}
+    }
+}
+
+void RtdScheduleParser::handleEndTag(const QByteArray& name)
+{
+    for (int i = m_stack.size() - 1; i >= 0; i--) {
+	if (m_stack[i].name == name) {
+	    popTo(i);
+	    return;
+	}
+    }
+
+    // a stray end tag: ignore it
+}
+
+// close the innermost element named in @p names, unless we hit one of
+// @p boundaries first
+void RtdScheduleParser::closeImplied(const char *const *names, const char *const *boundaries)
+{
+    for (int i = m_stack.size() - 1; i >= 0; i--) {
+	const QByteArray& name = m_stack[i].name;
+	if (nameIn(name, names)) {
+	    popTo(i);
+	    return;
+	}
+	if (nameIn(name, boundaries))
+	    return;
+    }
+}
+
+// pop elements until the stack is @p depth deep, finishing their captures
+void RtdScheduleParser::popTo(int depth)
+{
+    while (m_stack.size() > depth) {
+	Element element = m_stack.takeLast();
+	for (int i = 0; i < element.captures; i++)
+	    finishCapture(m_captures.takeLast());
+
+	if (m_stack.size() == m_rowDepth)
+	    m_rowDepth = -1;
+	if (m_stack.size() == m_headRowDepth)
+	    m_headRowDepth = -1;
+	if (m_stack.size() == m_tableDepth) {
+	    m_tableDepth = -1;
+	    m_tableClosed = true;
+	}
+    }
+}
+
+void RtdScheduleParser::startCapture(CaptureRole role)
+{
+    m_captures.append(Capture(role, m_stack.size()));
+    m_stack.last().captures++;
+}
+
+void RtdScheduleParser::finishCapture(const Capture& capture)
+{
+    switch (capture.role) {
+    case ValidityCapture: {
+	if (!m_validAsOf.isEmpty())
+	    break;
+	QRegExp validity(QLatin1String("Schedule\\s+effective\\s+as\\s+of\\s+(\\w+\\s+\\d+,\\s+\\d+)"));
+	if (validity.indexIn(htmlText(capture.text)) >= 0)
+	    m_validAsOf = validity.cap(1);
+	break;
+    }
+    case NoServiceCapture: {
+	// RTD's answer for a route that doesn't run on the day asked for
+	QRegExp noService(QLatin1String("no\\s+service\\s+on\\s+this\\s+route"), Qt::CaseInsensitive);
+	if (noService.indexIn(htmlText(capture.text)) >= 0)
+	    m_noService = true;
+	break;
+    }
+    case DirectionCapture: {
+	QString text = htmlText(capture.text);
+	QRegExp bound(QLatin1String("(North|South|East|West)\\s+Bound"));
+	QRegExp other(QLatin1String("(Loop|Clockwise|Counterclockwise)"));
+	QString found;
+	if (bound.indexIn(text) >= 0)
+	    found = bound.cap(1);
+	else if (other.indexIn(text) >= 0)
+	    found = other.cap(1);
+	else
+	    break;
+
+	QString currentDir;
+	if (found == QLatin1String("North"))
+	    currentDir = QLatin1String("N");
+	else if (found == QLatin1String("South"))
+	    currentDir = QLatin1String("S");
+	else if (found == QLatin1String("East"))
+	    currentDir = QLatin1String("E");
+	else if (found == QLatin1String("West"))
+	    currentDir = QLatin1String("W");
+	else if (found == QLatin1String("Loop"))
+	    currentDir = QLatin1String("Loop");
+	else if (found == QLatin1String("Clockwise"))
+	    currentDir = QLatin1String("CW");
+	else
+	    currentDir = QLatin1String("CCW");
+
+	if (m_availableDirections.isEmpty())
+	    m_availableDirections = currentDir;
+	else
+	    m_availableDirections += '-' + currentDir;
+
+	// _not_ a link: the currently listed schedule's direction
+	if (!capture.hasLink)
+	    m_direction = currentDir;
+	break;
+    }
+    case StationCapture: {
+	QString stationName = htmlText(capture.text);
+	if (m_schedules.contains(stationName))
+	    stationName += QLatin1String(" (return)");
+	if (!m_schedules.contains(stationName))
+	    m_schedules.insert(stationName, QVector<Departure>());
+	m_stations << stationName;
+	break;
+    }
+    case SubrouteProbeCapture:
+	m_hasSubroutes = !capture.text.isEmpty();
+	m_subroutesProbed = true;
+	break;
+    case CellCapture:
+	handleCell(htmlText(capture.text));
+	break;
+    }
+}
+
+// for each row, look at the table cells within that row: if we have subroutes,
+// the first cell is the subroute; otherwise the cells are times, each going with
+// its respective station from the header row
+void RtdScheduleParser::handleCell(const QString& text)
+{
+    if (!m_error.isEmpty())
+	return;
+
+    // not a real column
+    if (text.trimmed().isEmpty())
+	return;
+
+    if (m_rowFirst && m_hasSubroutes) {
+	int end = text.length();
+	while (end > 0 && text[end - 1].isSpace())
+	    end--;
+	m_rowSubroute = text.left(end);
+	m_rowFirst = false;
+	return;
+    }
+
+    // no stop at this station for this bus
+    if (text.trimmed() == QLatin1String("--")) {
+	m_rowStation++;
+	return;
+    }
+
+    if (m_rowStation >= m_stations.size()) {
+	m_error = QString(QLatin1String("Bad station: (i=%1)")).arg(m_rowStation);
+	return;
+    }
+
+    int minute = parseTime(text.trimmed());
+    if (minute >= 0) {
+	int subroute = subrouteIndex(m_rowSubroute.isEmpty() ? m_routeName : m_rowSubroute);
+	m_schedules[m_stations[m_rowStation]].append(Departure(minute, subroute));
+    }
+    m_rowStation++;
+}
+
+int RtdScheduleParser::subrouteIndex(const QString& subroute)
+{
+    int index = m_subroutes.indexOf(subroute);
+    if (index < 0) {
+	index = m_subroutes.size();
+	m_subroutes << subroute;
+    }
+    return index;
+}
+
+RtdSchedulePage RtdScheduleParser::result()
+{
+    // whatever was held back is all there is
+    if (m_bufferPos < m_buffer.length())
+	feed(m_buffer, m_bufferPos, true);
+    m_buffer.clear();
+    m_bufferPos = 0;
+
+    // a page that stops in the middle of its timetable was cut off
+    bool truncated = (m_tableDepth >= 0);
+
+    // close anything the page left open
+    popTo(0);
+
+    RtdSchedulePage page;
+
+    // no headline: RTD's page for a route that doesn't run that day, unless
+    // there's a timetable we somehow couldn't make sense of
+    if (m_validAsOf.isEmpty()) {
+	bool sawTable = (truncated || m_tableClosed);
+	if (m_noService || !sawTable)
+	    page.status = RtdSchedulePage::NotFound;
+	return page;
+    }
+
+    page.validAsOf = parseDate(m_validAsOf);
+    if (!m_error.isEmpty() || !page.validAsOf.isValid() || m_direction.isEmpty() || m_availableDirections.isEmpty())
+	return page;
+    if (truncated || !m_tableClosed)
+	return page;
+
+    page.status = RtdSchedulePage::Found;
+    page.direction = m_direction;
+    page.availableDirections = m_availableDirections;
+
+    RtdSchedule& schedule = page.schedule;
+    schedule.stations = m_schedules.keys();
+    qSort(schedule.stations);
+    schedule.subroutes = m_subroutes;
+
+    foreach (const QString& station, schedule.stations) {
+	const QVector<Departure>& departures = m_schedules[station];
+
+	// the page lists each stop's buses in order, wrapping around past
+	// midnight: count those from the start of the service day
+	QList<QPair<int, int> > sorted;
+	int dayStart = 0;
+	bool pm = false;
+	for (int i = 0; i < departures.size(); i++) {
+	    int minute = departures[i].minute;
+	    if (minute >= 12*60)
+		pm = true;
+	    if (pm && minute < 12*60) {
+		pm = false;
+		dayStart += 1440;
+	    }
+	    sorted << qMakePair(dayStart + minute, departures[i].subroute);
+	}
+
+	// the odd bus may be listed out of order: it's cheap to make sure
+	qSort(sorted);
+	for (int i = 0; i < sorted.size(); i++) {
+	    schedule.minutes.append(sorted[i].first);
+	    schedule.subrouteIndexes.append(sorted[i].second);
+	}
+	schedule.stopStarts.append(schedule.minutes.size());
+    }
+
+    return page;
+}
@@ -0,0 +1,142 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RTDSCHEDULEPARSER_H
+#define RTDSCHEDULEPARSER_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDate>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+#include "rtdschedule.h"
+
+// A single-pass scanner for RTD's schedule pages. It walks the raw html once,
+// keeping only a stack of open element names, and picks out the same pieces
+// that the old WebKit + XPath pipeline did: the validity headline, the
+// direction headers, the station names, and the time cells of each row.
+//
+// The page can be fed in as it arrives off the network: a tag, comment or run
+// of text that is cut off at the end of one chunk is held back until the next.
+//
+// The result is the page's validity date and directions, and its timetable
+// packed the way the timetable store keeps it: buses without a subroute of
+// their own are filed under the name of the route. A page with neither a
+// validity headline nor a schedule table is RTD saying that the route doesn't
+// run that day, and is NotFound, as is any page with RTD's "no service" text;
+// a schedule table without a headline, or one that the page ends in the middle
+// of, is Unreadable.
+class RtdScheduleParser
+{
+    public:
+	explicit RtdScheduleParser(const QString& routeName = QString());
+
+	void addData(const QByteArray& html);
+	RtdSchedulePage result();
+
+	static RtdSchedulePage parse(const QByteArray& html, const QString& routeName);
+
+	// minutes since midnight of a time like "1005A" or "915P", or -1
+	static int parseTime(const QString& str);
+	// a date like "August 23, 2009"
+	static QDate parseDate(const QString& str);
+
+    private:
+	enum CaptureRole {
+	    ValidityCapture,
+	    NoServiceCapture,
+	    DirectionCapture,
+	    StationCapture,
+	    SubrouteProbeCapture,
+	    CellCapture
+	};
+
+	struct Capture {
+	    CaptureRole role;
+	    QByteArray text;
+	    int depth;          // stack depth of the element that owns us
+	    bool hasLink;
+	    bool done;
+
+	    Capture() { }
+	    Capture(CaptureRole r, int d) : role(r), depth(d), hasLink(false), done(false) { }
+	};
+
+	struct Element {
+	    QByteArray name;
+	    int captures;       // how many entries of m_captures this element owns
+
+	    Element() { }
+	    Element(const QByteArray& n) : name(n), captures(0) { }
+	};
+
+	int feed(const QByteArray& html, int pos, bool last);
+	int markupEnd(const QByteArray& html, int pos) const;
+	int handleMarkup(const QByteArray& html, int pos);
+	void handleText(const char *text, int length);
+	void handleStartTag(const QByteArray& name, const QByteArray& cls, bool selfClosing);
+	void handleEndTag(const QByteArray& name);
+
+	void closeImplied(const char *const *names, const char *const *boundaries);
+	void popTo(int depth);
+	void startCapture(CaptureRole role);
+	void finishCapture(const Capture& capture);
+	void handleCell(const QString& text);
+	int subrouteIndex(const QString& subroute);
+
+	// one time cell: minutes since midnight, and an index into m_subroutes
+	struct Departure {
+	    int minute;
+	    int subroute;
+
+	    Departure() { }
+	    Departure(int m, int s) : minute(m), subroute(s) { }
+	};
+
+	QString m_routeName;
+	QByteArray m_buffer;        // the chunk(s) being scanned
+	int m_bufferPos;            // where the part of m_buffer not yet scanned starts
+	QList<Element> m_stack;
+	QList<Capture> m_captures;
+	int m_rowDepth;
+	int m_headRowDepth;
+	int m_tableDepth;           // of the schedule table, while it's open
+	bool m_tableClosed;
+
+	// per-row state
+	bool m_rowFirst;
+	int m_rowStation;
+	QString m_rowSubroute;
+
+	QString m_validAsOf;
+	bool m_noService;
+	QString m_direction;
+	QString m_availableDirections;
+	QStringList m_stations;
+	QHash<QString, QVector<Departure> > m_schedules;
+	QStringList m_subroutes;
+	bool m_hasSubroutes;
+	bool m_subroutesProbed;
+	QString m_error;
+};
+
+#endif
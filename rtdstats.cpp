@@ -0,0 +1,97 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "rtdstats.h"
+
+#include <QtCore/QTime>
+#include <QtCore/QVariantList>
+#include <QtCore/QVariantMap>
+
+#ifdef Q_OS_UNIX
+#include <time.h>
+#endif
+
+qint64 rtdMonotonicMicros()
+{
+#if defined(Q_OS_UNIX) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+	return qint64(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#endif
+    // only good to the millisecond, and wraps at midnight, but it will do
+    return qint64(QTime(0, 0).msecsTo(QTime::currentTime())) * 1000;
+}
+
+RtdHistogram::RtdHistogram()
+    : m_count(0),
+      m_sum(0),
+      m_max(0)
+{
+    for (int i = 0; i < BUCKETS; i++)
+	m_buckets[i] = 0;
+}
+
+void RtdHistogram::record(qint64 value)
+{
+    if (value < 0)
+	value = 0;
+
+    int bucket = 0;
+    while (bucket < BUCKETS - 1 && (value >> bucket) != 0)
+	bucket++;
+
+    m_buckets[bucket]++;
+    m_count++;
+    m_sum += value;
+    m_max = qMax(m_max, value);
+}
+
+qint64 RtdHistogram::percentile(int percent) const
+{
+    qint64 wanted = (m_count * percent + 99) / 100;
+    qint64 seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+	seen += m_buckets[i];
+	if (seen >= wanted && seen > 0)
+	    return qMin(i ? (Q_INT64_C(1) << i) - 1 : Q_INT64_C(0), m_max);
+    }
+    return m_max;
+}
+
+QVariant RtdHistogram::toVariant() const
+{
+    QVariantMap ret;
+    ret.insert(QLatin1String("count"), m_count);
+    ret.insert(QLatin1String("mean"), m_count ? m_sum / m_count : 0);
+    ret.insert(QLatin1String("max"), m_max);
+    ret.insert(QLatin1String("p50"), percentile(50));
+    ret.insert(QLatin1String("p90"), percentile(90));
+    ret.insert(QLatin1String("p99"), percentile(99));
+
+    // up to the last bucket with anything in it
+    int used = BUCKETS;
+    while (used > 0 && m_buckets[used - 1] == 0)
+	used--;
+    QVariantList buckets;
+    for (int i = 0; i < used; i++)
+	buckets << m_buckets[i];
+    ret.insert(QLatin1String("buckets"), buckets);
+
+    return ret;
+}
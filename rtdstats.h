@@ -0,0 +1,68 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RTDSTATS_H
+#define RTDSTATS_H
+
+#include <QtCore/QVariant>
+
+// microseconds on a clock that only ever goes forwards, for timing the hot paths
+qint64 rtdMonotonicMicros();
+
+// A histogram of non-negative values with power-of-two buckets: cheap enough
+// to record into on every fetch, parse and lookup, and accurate enough to tell
+// a microsecond from a millisecond from a second. Percentiles are estimated as
+// the top of the bucket they fall in.
+class RtdHistogram
+{
+    public:
+	enum { BUCKETS = 40 };
+
+	RtdHistogram();
+
+	void record(qint64 value);
+	qint64 count() const { return m_count; }
+
+	// a map of count, mean, max, p50, p90 and p99, and the bucket counts:
+	// bucket 0 holds the zeroes, and bucket i the values below 2^i
+	QVariant toVariant() const;
+
+    private:
+	qint64 percentile(int percent) const;
+
+	qint64 m_buckets[BUCKETS];
+	qint64 m_count;
+	qint64 m_sum;
+	qint64 m_max;
+};
+
+// records how long it lived, in microseconds, into a histogram
+class RtdHistogramTimer
+{
+    public:
+	explicit RtdHistogramTimer(RtdHistogram *histogram)
+	  : m_histogram(histogram), m_start(rtdMonotonicMicros()) { }
+	~RtdHistogramTimer() { m_histogram->record(rtdMonotonicMicros() - m_start); }
+
+    private:
+	RtdHistogram *m_histogram;
+	qint64 m_start;
+};
+
+#endif
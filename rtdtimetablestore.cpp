@@ -0,0 +1,611 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "rtdtimetablestore.h"
+
+#include <KDE/KDebug>
+#include <KDE/KSaveFile>
+
+#include <QtCore/QMap>
+#include <QtCore/QMetaObject>
+#include <QtCore/QtAlgorithms>
+
+enum {
+    STORE_MAGIC = 0x53445452,   // "RTDS"
+    STORE_FORMAT_VERSION = 4
+};
+
+// The file is laid out as the header, followed by each of these sections in
+// turn, all in native byte order (it's a local cache, never shared):
+//   quint32 stringStarts[stringCount + 1]  offsets of each string, in QChars
+//   RouteEntry routes[routeCount]          sorted by (name id, day, direction)
+//   StopEntry stops[stopCount]             sorted by station id within each route
+//   quint32 subrouteRefs[subrouteRefCount] string ids of each route's subroutes
+//   quint16 minutes[departureCount]        sorted minutes since the service day began
+//   quint16 subrouteIndexes[departureCount] index into the route's subroutes
+//   QChar strings[stringLength]            the intern table, in id order
+struct RtdTimetableStore::Header {
+    quint32 magic;
+    quint32 version;
+    qint32 validAsOf;           // julian day
+    quint32 stringCount;
+    quint32 stringLength;
+    quint32 routeCount;
+    quint32 stopCount;
+    quint32 subrouteRefCount;
+    quint32 departureCount;
+};
+
+struct RtdTimetableStore::RouteEntry {
+    quint32 name;
+    quint8 day;
+    quint8 direction;
+    quint16 subrouteCount;
+    quint32 firstSubroute;
+    quint32 firstStop;
+    quint32 stopCount;
+};
+
+struct RtdTimetableStore::StopEntry {
+    quint32 station;
+    quint32 firstDeparture;
+    quint32 departureCount;
+};
+
+// byte offsets of each section of a store with the given header
+struct StoreLayout {
+    qint64 stringStarts;
+    qint64 routes;
+    qint64 stops;
+    qint64 subrouteRefs;
+    qint64 minutes;
+    qint64 subrouteIndexes;
+    qint64 strings;
+    qint64 size;
+
+    StoreLayout(const RtdTimetableStore::Header& h)
+    {
+	stringStarts = sizeof(RtdTimetableStore::Header);
+	routes = stringStarts + (qint64(h.stringCount) + 1) * sizeof(quint32);
+	stops = routes + qint64(h.routeCount) * sizeof(RtdTimetableStore::RouteEntry);
+	subrouteRefs = stops + qint64(h.stopCount) * sizeof(RtdTimetableStore::StopEntry);
+	minutes = subrouteRefs + qint64(h.subrouteRefCount) * sizeof(quint32);
+	subrouteIndexes = minutes + qint64(h.departureCount) * sizeof(quint16);
+	strings = subrouteIndexes + qint64(h.departureCount) * sizeof(quint16);
+	size = strings + qint64(h.stringLength) * sizeof(QChar);
+    }
+};
+
+// whether every offset, count and id in the store at @p data points inside
+// the store: a truncated or corrupted file mustn't send a lookup off the end
+// of the mapping
+static bool isConsistent(const uchar *data, const StoreLayout& layout)
+{
+    const RtdTimetableStore::Header& h = *reinterpret_cast<const RtdTimetableStore::Header *>(data);
+    const quint32 *stringStarts = reinterpret_cast<const quint32 *>(data + layout.stringStarts);
+    const RtdTimetableStore::RouteEntry *routes =
+	reinterpret_cast<const RtdTimetableStore::RouteEntry *>(data + layout.routes);
+    const RtdTimetableStore::StopEntry *stops =
+	reinterpret_cast<const RtdTimetableStore::StopEntry *>(data + layout.stops);
+    const quint32 *subrouteRefs = reinterpret_cast<const quint32 *>(data + layout.subrouteRefs);
+    const quint16 *subrouteIndexes = reinterpret_cast<const quint16 *>(data + layout.subrouteIndexes);
+
+    if (stringStarts[0] != 0 || stringStarts[h.stringCount] > h.stringLength)
+	return false;
+    for (quint32 i = 0; i < h.stringCount; i++) {
+	if (stringStarts[i + 1] < stringStarts[i])
+	    return false;
+    }
+
+    for (quint32 i = 0; i < h.subrouteRefCount; i++) {
+	if (subrouteRefs[i] >= h.stringCount)
+	    return false;
+    }
+
+    for (quint32 r = 0; r < h.routeCount; r++) {
+	const RtdTimetableStore::RouteEntry& route = routes[r];
+	if (route.name >= h.stringCount ||
+	    route.firstStop > h.stopCount || route.stopCount > h.stopCount - route.firstStop ||
+	    route.firstSubroute > h.subrouteRefCount || route.subrouteCount > h.subrouteRefCount - route.firstSubroute)
+	    return false;
+
+	for (quint32 s = route.firstStop; s < route.firstStop + route.stopCount; s++) {
+	    const RtdTimetableStore::StopEntry& stop = stops[s];
+	    if (stop.station >= h.stringCount || stop.firstDeparture > h.departureCount ||
+		stop.departureCount > h.departureCount - stop.firstDeparture)
+		return false;
+
+	    for (quint32 d = stop.firstDeparture; d < stop.firstDeparture + stop.departureCount; d++) {
+		if (subrouteIndexes[d] >= route.subrouteCount)
+		    return false;
+	    }
+	}
+    }
+
+    return true;
+}
+
+static int compareChars(const QChar *a, int aLength, const QChar *b, int bLength)
+{
+    int n = qMin(aLength, bLength);
+    for (int i = 0; i < n; i++) {
+	if (a[i] != b[i])
+	    return (a[i].unicode() < b[i].unicode() ? -1 : 1);
+    }
+    return aLength - bLength;
+}
+
+bool RtdTimetableStore::RouteKey::operator<(const RouteKey& other) const
+{
+    if (name != other.name)
+	return name < other.name;
+    if (day != other.day)
+	return day < other.day;
+    return direction < other.direction;
+}
+
+uint qHash(const RtdTimetableStore::RouteKey& key)
+{
+    return key.name ^ (uint(key.day) << 24) ^ (uint(key.direction) << 16);
+}
+
+int RtdTimetableStore::Route::stopCount() const
+{
+    if (m_pending)
+	return m_pending->stations.size();
+    return (m_entry ? int(m_entry->stopCount) : 0);
+}
+
+quint32 RtdTimetableStore::Route::station(int stop) const
+{
+    if (m_pending)
+	return m_pending->stations[stop];
+    return m_store->m_stops[m_entry->firstStop + stop].station;
+}
+
+QVector<quint32> RtdTimetableStore::Route::subroutes() const
+{
+    if (m_pending)
+	return m_pending->subroutes;
+
+    const quint32 *refs = m_store->m_subrouteRefs + m_entry->firstSubroute;
+    QVector<quint32> ret(m_entry->subrouteCount);
+    for (int i = 0; i < ret.size(); i++)
+	ret[i] = refs[i];
+    return ret;
+}
+
+int RtdTimetableStore::Route::findStation(quint32 station) const
+{
+    if (m_pending) {
+	const QVector<quint32>& stations = m_pending->stations;
+	QVector<quint32>::const_iterator it = qBinaryFind(stations.constBegin(), stations.constEnd(), station);
+	return (it != stations.constEnd() ? it - stations.constBegin() : -1);
+    }
+
+    // each route's station table is sorted, so we can seek straight to the one we want
+    const StopEntry *stops = m_store->m_stops + m_entry->firstStop;
+    int low = 0;
+    int high = m_entry->stopCount;
+    while (low < high) {
+	int mid = (low + high) / 2;
+	if (stops[mid].station == station)
+	    return mid;
+	else if (stops[mid].station < station)
+	    low = mid + 1;
+	else
+	    high = mid;
+    }
+
+    return -1;
+}
+
+int RtdTimetableStore::Route::departureCount(int stop) const
+{
+    if (m_pending)
+	return m_pending->stopStarts[stop + 1] - m_pending->stopStarts[stop];
+    return m_store->m_stops[m_entry->firstStop + stop].departureCount;
+}
+
+const quint16 *RtdTimetableStore::Route::minutes(int stop) const
+{
+    if (m_pending)
+	return m_pending->minutes.constData() + m_pending->stopStarts[stop];
+    return m_store->m_minutes + m_store->m_stops[m_entry->firstStop + stop].firstDeparture;
+}
+
+const quint16 *RtdTimetableStore::Route::subrouteIndexes(int stop) const
+{
+    if (m_pending)
+	return m_pending->subrouteIndexes.constData() + m_pending->stopStarts[stop];
+    return m_store->m_subrouteIndexes + m_store->m_stops[m_entry->firstStop + stop].firstDeparture;
+}
+
+RtdTimetableStore::RtdTimetableStore(const QString& fileName, RtdInternTable *names)
+    : m_fileName(fileName),
+      m_names(names),
+      m_data(0),
+      m_size(0),
+      m_header(0),
+      m_epoch(0),
+      m_generation(0),
+      m_savedGeneration(0)
+{
+    map();
+}
+
+RtdTimetableStore::~RtdTimetableStore()
+{
+    unmap();
+}
+
+bool RtdTimetableStore::map()
+{
+    m_file.setFileName(m_fileName);
+    if (!m_file.open(QIODevice::ReadOnly))
+	return false;
+
+    m_size = m_file.size();
+    if (m_size < qint64(sizeof(Header))) {
+	unmap();
+	return false;
+    }
+
+    m_data = m_file.map(0, m_size);
+    if (!m_data) {
+	unmap();
+	return false;
+    }
+
+    m_header = reinterpret_cast<const Header *>(m_data);
+    if (m_header->magic != STORE_MAGIC || m_header->version != STORE_FORMAT_VERSION) {
+	unmap();
+	return false;
+    }
+
+    StoreLayout layout(*m_header);
+    if (layout.size > m_size) {
+	kWarning() << "truncated timetable store" << m_fileName;
+	unmap();
+	return false;
+    }
+    if (!isConsistent(m_data, layout)) {
+	kWarning() << "corrupt timetable store" << m_fileName;
+	unmap();
+	return false;
+    }
+
+    m_stringStarts = reinterpret_cast<const quint32 *>(m_data + layout.stringStarts);
+    m_routes = reinterpret_cast<const RouteEntry *>(m_data + layout.routes);
+    m_stops = reinterpret_cast<const StopEntry *>(m_data + layout.stops);
+    m_subrouteRefs = reinterpret_cast<const quint32 *>(m_data + layout.subrouteRefs);
+    m_minutes = reinterpret_cast<const quint16 *>(m_data + layout.minutes);
+    m_subrouteIndexes = reinterpret_cast<const quint16 *>(m_data + layout.subrouteIndexes);
+    m_strings = reinterpret_cast<const QChar *>(m_data + layout.strings);
+
+    // the file's string table is the intern table as it stood when the file
+    // was written: it has to agree with what we already know, and fills in
+    // whatever we don't
+    for (quint32 id = 0; id < m_header->stringCount; id++) {
+	const QChar *chars = m_strings + m_stringStarts[id];
+	int length = m_stringStarts[id + 1] - m_stringStarts[id];
+
+	if (id >= quint32(m_names->count())) {
+	    m_names->intern(QString(chars, length));
+	    continue;
+	}
+
+	const QString& known = m_names->string(id);
+	if (compareChars(chars, length, known.constData(), known.length()) != 0) {
+	    kWarning() << "timetable store names don't match" << m_fileName;
+	    unmap();
+	    return false;
+	}
+    }
+
+    m_validAsOf = QDate::fromJulianDay(m_header->validAsOf);
+    return true;
+}
+
+void RtdTimetableStore::unmap()
+{
+    if (m_data)
+	m_file.unmap(const_cast<uchar *>(m_data));
+    m_file.close();
+
+    m_data = 0;
+    m_size = 0;
+    m_header = 0;
+}
+
+const RtdTimetableStore::RouteEntry *RtdTimetableStore::findRoute(quint32 routeName, int day, int direction) const
+{
+    if (!m_header)
+	return 0;
+
+    int low = 0;
+    int high = m_header->routeCount;
+    while (low < high) {
+	int mid = (low + high) / 2;
+	const RouteEntry& entry = m_routes[mid];
+
+	int c = (entry.name == routeName ? 0 : (entry.name < routeName ? -1 : 1));
+	if (c == 0)
+	    c = int(entry.day) - day;
+	if (c == 0)
+	    c = int(entry.direction) - direction;
+
+	if (c == 0)
+	    return &entry;
+	else if (c < 0)
+	    low = mid + 1;
+	else
+	    high = mid;
+    }
+
+    return 0;
+}
+
+RtdTimetableStore::Route RtdTimetableStore::route(const QString& routeName, int day, int direction) const
+{
+    return route(m_names->find(routeName), day, direction);
+}
+
+RtdTimetableStore::Route RtdTimetableStore::route(quint32 name, int day, int direction) const
+{
+    Route ret;
+
+    // a route we've never heard of can't be in here
+    if (name == quint32(RtdInternTable::NoId))
+	return ret;
+
+    QHash<RouteKey, PackedRoute>::const_iterator it = m_pending.constFind(RouteKey(name, day, direction));
+    if (it != m_pending.constEnd()) {
+	ret.m_store = this;
+	ret.m_pending = &it.value();
+	return ret;
+    }
+
+    const RouteEntry *entry = findRoute(name, day, direction);
+    if (entry) {
+	ret.m_store = this;
+	ret.m_entry = entry;
+    }
+
+    return ret;
+}
+
+void RtdTimetableStore::insert(const QString& routeName, int day, int direction, const RtdSchedule& schedule)
+{
+    PackedRoute pending;
+    foreach (const QString& subroute, schedule.subroutes)
+	pending.subroutes.append(m_names->intern(subroute));
+
+    // put the stations in id order so they can be binary searched
+    QMap<quint32, int> stations;
+    for (int i = 0; i < schedule.stations.size(); i++)
+	stations.insert(m_names->intern(schedule.stations[i]), i);
+
+    pending.minutes.reserve(schedule.minutes.size());
+    pending.subrouteIndexes.reserve(schedule.subrouteIndexes.size());
+    for (QMap<quint32, int>::const_iterator st = stations.constBegin(); st != stations.constEnd(); st++) {
+	int i = st.value();
+	pending.stations.append(st.key());
+	for (quint32 j = schedule.stopStarts[i]; j < schedule.stopStarts[i + 1]; j++) {
+	    pending.minutes.append(schedule.minutes[j]);
+	    pending.subrouteIndexes.append(schedule.subrouteIndexes[j]);
+	}
+	pending.stopStarts.append(pending.minutes.size());
+    }
+
+    pending.generation = ++m_generation;
+    m_pending.insert(RouteKey(m_names->intern(routeName), day, direction), pending);
+}
+
+bool RtdTimetableStore::setValidAsOf(const QDate& validAsOf)
+{
+    if (validAsOf == m_validAsOf)
+	return false;
+
+    // everything we have is for some other set of schedules: start afresh, and
+    // make sure that an (empty) store with the new date gets written
+    m_validAsOf = validAsOf;
+    m_pending.clear();
+    unmap();
+    m_epoch++;
+    m_generation++;
+    return true;
+}
+
+RtdTimetableStore::PackedRoute RtdTimetableStore::packedRoute(const RouteEntry *entry) const
+{
+    Route r;
+    r.m_store = this;
+    r.m_entry = entry;
+
+    PackedRoute packed;
+    packed.subroutes = r.subroutes();
+    for (int stop = 0; stop < r.stopCount(); stop++) {
+	packed.stations.append(r.station(stop));
+
+	int count = r.departureCount(stop);
+	const quint16 *minutes = r.minutes(stop);
+	const quint16 *subrouteIndexes = r.subrouteIndexes(stop);
+	for (int i = 0; i < count; i++) {
+	    packed.minutes.append(minutes[i]);
+	    packed.subrouteIndexes.append(subrouteIndexes[i]);
+	}
+	packed.stopStarts.append(packed.minutes.size());
+    }
+
+    return packed;
+}
+
+QByteArray RtdTimetableStore::serialize(int *epoch, int *generation) const
+{
+    *epoch = m_epoch;
+    *generation = m_generation;
+
+    // gather every route we know about, newest first
+    QMap<RouteKey, PackedRoute> routes;
+    for (QHash<RouteKey, PackedRoute>::const_iterator it = m_pending.constBegin(); it != m_pending.constEnd(); it++)
+	routes.insert(it.key(), it.value());
+
+    if (m_header) {
+	for (quint32 i = 0; i < m_header->routeCount; i++) {
+	    const RouteEntry *entry = &m_routes[i];
+	    RouteKey key(entry->name, entry->day, entry->direction);
+	    if (!routes.contains(key))
+		routes.insert(key, packedRoute(entry));
+	}
+    }
+
+    // size everything up: the string table is the whole intern table
+    Header h;
+    h.magic = STORE_MAGIC;
+    h.version = STORE_FORMAT_VERSION;
+    h.validAsOf = m_validAsOf.toJulianDay();
+    h.stringCount = m_names->count();
+    h.stringLength = 0;
+    h.routeCount = routes.size();
+    h.stopCount = 0;
+    h.subrouteRefCount = 0;
+    h.departureCount = 0;
+
+    for (int i = 0; i < m_names->count(); i++)
+	h.stringLength += m_names->string(i).length();
+
+    for (QMap<RouteKey, PackedRoute>::const_iterator it = routes.constBegin(); it != routes.constEnd(); it++) {
+	h.stopCount += it.value().stations.size();
+	h.subrouteRefCount += it.value().subroutes.size();
+	h.departureCount += it.value().minutes.size();
+    }
+
+    StoreLayout layout(h);
+    QByteArray image(layout.size, '\0');
+    uchar *data = reinterpret_cast<uchar *>(image.data());
+
+    *reinterpret_cast<Header *>(data) = h;
+    quint32 *stringStarts = reinterpret_cast<quint32 *>(data + layout.stringStarts);
+    RouteEntry *routeEntries = reinterpret_cast<RouteEntry *>(data + layout.routes);
+    StopEntry *stopEntries = reinterpret_cast<StopEntry *>(data + layout.stops);
+    quint32 *subrouteRefs = reinterpret_cast<quint32 *>(data + layout.subrouteRefs);
+    quint16 *minutes = reinterpret_cast<quint16 *>(data + layout.minutes);
+    quint16 *subrouteIndexes = reinterpret_cast<quint16 *>(data + layout.subrouteIndexes);
+    QChar *chars = reinterpret_cast<QChar *>(data + layout.strings);
+
+    quint32 pos = 0;
+    for (int i = 0; i < m_names->count(); i++) {
+	const QString& str = m_names->string(i);
+	stringStarts[i] = pos;
+	memcpy(chars + pos, str.constData(), str.length() * sizeof(QChar));
+	pos += str.length();
+    }
+    stringStarts[m_names->count()] = pos;
+
+    // both forms of a route already keep their stations in id order
+    quint32 stop = 0;
+    quint32 subrouteRef = 0;
+    quint32 departure = 0;
+    for (QMap<RouteKey, PackedRoute>::const_iterator it = routes.constBegin(); it != routes.constEnd(); it++) {
+	const PackedRoute& route = it.value();
+	RouteEntry *entry = routeEntries++;
+
+	entry->name = it.key().name;
+	entry->day = it.key().day;
+	entry->direction = it.key().direction;
+	entry->subrouteCount = route.subroutes.size();
+	entry->firstSubroute = subrouteRef;
+	entry->firstStop = stop;
+	entry->stopCount = route.stations.size();
+
+	foreach (quint32 subroute, route.subroutes)
+	    subrouteRefs[subrouteRef++] = subroute;
+
+	for (int i = 0; i < route.stations.size(); i++) {
+	    int count = route.stopStarts[i + 1] - route.stopStarts[i];
+
+	    StopEntry *stopEntry = &stopEntries[stop++];
+	    stopEntry->station = route.stations[i];
+	    stopEntry->firstDeparture = departure;
+	    stopEntry->departureCount = count;
+
+	    memcpy(minutes + departure, route.minutes.constData() + route.stopStarts[i], count * sizeof(quint16));
+	    memcpy(subrouteIndexes + departure, route.subrouteIndexes.constData() + route.stopStarts[i],
+		   count * sizeof(quint16));
+	    departure += count;
+	}
+    }
+
+    return image;
+}
+
+bool RtdTimetableStore::write(const QString& fileName, const QByteArray& image)
+{
+    KSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+	return false;
+
+    if (file.write(image) != image.size()) {
+	file.abort();
+	return false;
+    }
+
+    return file.finalize();
+}
+
+void RtdTimetableStore::adopt(int epoch, int generation)
+{
+    // the store was reset while this image was being written
+    if (epoch != m_epoch)
+	return;
+
+    unmap();
+    if (!map())
+	return;
+
+    QHash<RouteKey, PackedRoute>::iterator it = m_pending.begin();
+    while (it != m_pending.end()) {
+	if (it.value().generation <= generation)
+	    it = m_pending.erase(it);
+	else
+	    it++;
+    }
+    m_savedGeneration = generation;
+}
+
+RtdTimetableStoreWriter::RtdTimetableStoreWriter(const QString& fileName, const QByteArray& image,
+						 int epoch, int generation, QObject *receiver, const char *member)
+    : m_fileName(fileName),
+      m_image(image),
+      m_epoch(epoch),
+      m_generation(generation),
+      m_receiver(receiver),
+      m_member(member)
+{
+}
+
+void RtdTimetableStoreWriter::run()
+{
+    bool ok = RtdTimetableStore::write(m_fileName, m_image);
+    m_image.clear();
+
+    QMetaObject::invokeMethod(m_receiver, m_member, Qt::QueuedConnection,
+			      Q_ARG(int, m_epoch), Q_ARG(int, m_generation), Q_ARG(bool, ok));
+}
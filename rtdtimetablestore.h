@@ -0,0 +1,179 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RTDTIMETABLESTORE_H
+#define RTDTIMETABLESTORE_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDate>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QRunnable>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+#include "rtdinterntable.h"
+#include "rtdschedule.h"
+
+class QObject;
+
+// All of the cached timetables in one versioned file, keyed by the date the
+// schedules are valid as of. The file is memory mapped and queried in place:
+// looking up a route is a binary search of the route index, looking up one of
+// its stations is a binary search of that route's station table, and a stop's
+// departures are handed out as pointers straight into the mapping. Every
+// offset in the file is checked once when it's mapped; a file that fails the
+// checks is ignored, just like one in an old format.
+//
+// Names are kept as ids in the engine's intern table, and the file's string
+// table is a snapshot of it, so those searches compare integers and the ids
+// read from the file mean the same thing as the ones in memory.
+//
+// Freshly parsed routes are kept in memory until the engine asks for the
+// store to be written out, which rewrites the whole file in one go.
+class RtdTimetableStore
+{
+    public:
+	struct Header;
+	struct RouteEntry;
+	struct StopEntry;
+
+	// one route's timetable in terms of the intern table, with its stations
+	// in id order; this is the in-memory form of a route not yet written out
+	struct PackedRoute {
+	    QVector<quint32> stations;
+	    QVector<quint32> subroutes;
+	    QVector<quint32> stopStarts;        // stations.size() + 1 offsets into the arrays below
+	    QVector<quint16> minutes;
+	    QVector<quint16> subrouteIndexes;
+	    int generation;
+
+	    PackedRoute() : generation(0) { stopStarts.append(0); }
+	};
+
+	// a read-only view of one route; it stays valid until the store is next modified
+	class Route {
+	    public:
+		Route() : m_store(0), m_entry(0), m_pending(0) { }
+
+		bool isValid() const { return m_store != 0; }
+		int stopCount() const;
+		quint32 station(int stop) const;
+		QVector<quint32> subroutes() const;
+
+		// the index of @p station, or -1 if this route doesn't stop there
+		int findStation(quint32 station) const;
+
+		int departureCount(int stop) const;
+		const quint16 *minutes(int stop) const;
+		const quint16 *subrouteIndexes(int stop) const;
+
+	    private:
+		friend class RtdTimetableStore;
+		const RtdTimetableStore *m_store;
+		const RouteEntry *m_entry;
+		const PackedRoute *m_pending;
+	};
+
+	RtdTimetableStore(const QString& fileName, RtdInternTable *names);
+	~RtdTimetableStore();
+
+	QString fileName() const { return m_fileName; }
+	RtdInternTable *names() const { return m_names; }
+
+	// the validity date of everything in the store; changing it throws away
+	// all of the stored timetables, and returns true, after which the store
+	// no longer refers to any of the intern table's ids
+	QDate validAsOf() const { return m_validAsOf; }
+	bool setValidAsOf(const QDate& validAsOf);
+
+	Route route(const QString& routeName, int day, int direction) const;
+	Route route(quint32 routeName, int day, int direction) const;
+	void insert(const QString& routeName, int day, int direction, const RtdSchedule& schedule);
+
+	// writing the store is split so that the disk I/O can happen on another thread:
+	// serialize() takes a snapshot, write() puts it on disk, and adopt() switches
+	// the store over to the new file once it's there
+	bool isDirty() const { return m_generation != m_savedGeneration; }
+	QByteArray serialize(int *epoch, int *generation) const;
+	static bool write(const QString& fileName, const QByteArray& image);
+	void adopt(int epoch, int generation);
+
+    private:
+	struct RouteKey {
+	    quint32 name;
+	    int day;
+	    int direction;
+
+	    RouteKey() { }
+	    RouteKey(quint32 n, int d, int dir) : name(n), day(d), direction(dir) { }
+	    bool operator==(const RouteKey& other) const
+	    { return name == other.name && day == other.day && direction == other.direction; }
+	    bool operator<(const RouteKey& other) const;
+	};
+	friend uint qHash(const RouteKey& key);
+
+	bool map();
+	void unmap();
+	const RouteEntry *findRoute(quint32 routeName, int day, int direction) const;
+	PackedRoute packedRoute(const RouteEntry *entry) const;
+
+	QString m_fileName;
+	RtdInternTable *m_names;
+	QFile m_file;
+	const uchar *m_data;
+	qint64 m_size;
+
+	const Header *m_header;
+	const quint32 *m_stringStarts;
+	const RouteEntry *m_routes;
+	const StopEntry *m_stops;
+	const quint32 *m_subrouteRefs;
+	const quint16 *m_minutes;
+	const quint16 *m_subrouteIndexes;
+	const QChar *m_strings;
+
+	QDate m_validAsOf;
+	QHash<RouteKey, PackedRoute> m_pending;
+	int m_epoch;
+	int m_generation;
+	int m_savedGeneration;
+};
+
+// writes a serialized store image out on a worker thread, then invokes
+// @p member (taking the store epoch and generation) on @p receiver
+class RtdTimetableStoreWriter : public QRunnable
+{
+    public:
+	RtdTimetableStoreWriter(const QString& fileName, const QByteArray& image, int epoch, int generation,
+				QObject *receiver, const char *member);
+
+	void run();
+
+    private:
+	QString m_fileName;
+	QByteArray m_image;
+	int m_epoch;
+	int m_generation;
+	QObject *m_receiver;
+	const char *m_member;
+};
+
+#endif
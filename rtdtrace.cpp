@@ -0,0 +1,117 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "rtdtrace.h"
+
+#include <QtCore/QCoreApplication>
+
+#include "rtdstats.h"
+
+static QByteArray jsonString(const QString& s)
+{
+    QByteArray ret = "\"";
+    foreach (const QChar& c, s) {
+	ushort u = c.unicode();
+	if (u == '"' || u == '\\') {
+	    ret += '\\';
+	    ret += char(u);
+	} else if (u < 0x20 || u >= 0x7f) {
+	    ret += "\\u" + QByteArray::number(u, 16).rightJustified(4, '0');
+	} else {
+	    ret += char(u);
+	}
+    }
+    ret += '"';
+    return ret;
+}
+
+RtdTracer::RtdTracer()
+    : m_first(true),
+      m_pid(0)
+{
+}
+
+RtdTracer::~RtdTracer()
+{
+    if (m_file.isOpen())
+	m_file.write("\n]\n");
+}
+
+bool RtdTracer::open(const QString& fileName)
+{
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+	return false;
+
+    m_pid = QCoreApplication::applicationPid();
+    m_first = true;
+    m_file.write("[\n");
+    return true;
+}
+
+QString RtdTracer::idString(const void *id)
+{
+    return QLatin1String("0x") + QString::number(quintptr(id), 16);
+}
+
+qint64 RtdTracer::now()
+{
+    return rtdMonotonicMicros();
+}
+
+void RtdTracer::span(const char *name, const void *id, qint64 start, qint64 end, const QString& source,
+		     const QString& detail)
+{
+    if (!isEnabled())
+	return;
+
+    event('b', name, id, start, source, detail);
+    event('e', name, id, end, QString(), QString());
+}
+
+void RtdTracer::event(char phase, const char *name, const void *id, qint64 ts, const QString& source,
+		      const QString& detail)
+{
+    QByteArray line = (m_first ? "" : ",\n");
+    m_first = false;
+
+    line += "{\"name\":" + jsonString(QLatin1String(name)) + ",\"cat\":\"rtddenver\",\"ph\":\"" + phase + '"';
+    line += ",\"ts\":" + QByteArray::number(ts) + ",\"pid\":" + QByteArray::number(m_pid) + ",\"tid\":1";
+    if (id)
+	line += ",\"id\":" + jsonString(idString(id));
+    if (phase == 'i')
+	line += ",\"s\":\"p\"";
+
+    line += ",\"args\":{";
+    bool haveArgs = false;
+    if (id) {
+	line += "\"job\":" + jsonString(idString(id));
+	haveArgs = true;
+    }
+    if (!source.isEmpty()) {
+	line += QByteArray(haveArgs ? "," : "") + "\"source\":" + jsonString(source);
+	haveArgs = true;
+    }
+    if (!detail.isEmpty())
+	line += QByteArray(haveArgs ? "," : "") + "\"detail\":" + jsonString(detail);
+    line += "}}";
+
+    m_file.write(line);
+    m_file.flush();
+}
@@ -0,0 +1,74 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RTDTRACE_H
+#define RTDTRACE_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QString>
+
+// Records the stages of the engine's pipeline as spans in Chrome's trace-event
+// JSON format, for loading into chrome://tracing or Perfetto to see where a
+// source's time went. The spans are asynchronous ones, since the stages of
+// different pages overlap; each is tagged with the job it belongs to and the
+// source(s) waiting on it.
+//
+// Tracing is off unless a trace file is opened, and then every call is a
+// no-op; the file is written as events happen, so a trace is still readable
+// if the engine never gets to close it. The tracer belongs to the Plasma main
+// thread: times from the workers are handed back and recorded from there.
+class RtdTracer
+{
+    public:
+	RtdTracer();
+	~RtdTracer();
+
+	bool open(const QString& fileName);
+	bool isEnabled() const { return m_file.isOpen(); }
+
+	// a span that's under way: begin() and end() are matched up by name and @p id
+	void begin(const char *name, const void *id, const QString& source = QString(),
+		   const QString& detail = QString())
+	{ if (isEnabled()) event('b', name, id, now(), source, detail); }
+	void end(const char *name, const void *id, const QString& source = QString(),
+		 const QString& detail = QString())
+	{ if (isEnabled()) event('e', name, id, now(), source, detail); }
+
+	// a span that's already over, timed with rtdMonotonicMicros()
+	void span(const char *name, const void *id, qint64 start, qint64 end, const QString& source = QString(),
+		  const QString& detail = QString());
+
+	// something that happened at a moment
+	void instant(const char *name, const QString& source = QString(), const QString& detail = QString())
+	{ if (isEnabled()) event('i', name, 0, now(), source, detail); }
+
+	static QString idString(const void *id);
+
+    private:
+	static qint64 now();
+	void event(char phase, const char *name, const void *id, qint64 ts, const QString& source,
+		   const QString& detail);
+
+	QFile m_file;
+	bool m_first;
+	qint64 m_pid;
+};
+
+#endif
@@ -0,0 +1,141 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+// The schedule parser against small hand-written pages in RTD's layout: what
+// it makes of their text, and which pages count as schedules at all.
+
+#include <QtTest/QtTest>
+
+#include <qtest_kde.h>
+
+#include "../rtdscheduleparser.h"
+
+// a page for route 15 eastbound with three stations and one bus, the third
+// station being called @p station
+static QByteArray schedulePage(const QByteArray& station)
+{
+    return QByteArray(
+	"<html><body>\n"
+	"<p class=\"bodyBlueHeadline\">Schedule effective as of August 23, 2009</p>\n"
+	"<table class=\"scheduleHeader\"><tr><td class=\"scheduleHeaderBlueHilite\">East Bound</td></tr></table>\n"
+	"<table class=\"schedule\">\n"
+	"<tr class=\"headrow\" title=it's>\n"
+	"<td><div class=\"scheduleStations\">Colfax &amp; Broadway</div></td>\n"
+	"<td><div class=\"scheduleStations\">Colfax &amp; Downing</div></td>\n"
+	"<td><div class=\"scheduleStations\">") + station + QByteArray("</div></td>\n"
+	"</tr>\n"
+	"<tr class=\"row\"><td>440A<td>444A<td>450A\n"
+	"</table>\n"
+	"</body></html>\n");
+}
+
+static RtdSchedulePage parseStreamed(const QByteArray& html, int chunk)
+{
+    RtdScheduleParser parser(QLatin1String("15"));
+    for (int pos = 0; pos < html.length(); pos += chunk)
+	parser.addData(html.mid(pos, chunk));
+    return parser.result();
+}
+
+class RtdScheduleParserTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+	void entities_data();
+	void entities();
+	void streamed();
+	void status_data();
+	void status();
+};
+
+void RtdScheduleParserTest::entities_data()
+{
+    QTest::addColumn<QByteArray>("html");
+    QTest::addColumn<QString>("text");
+
+    QTest::newRow("plain") << QByteArray("Union Station") << QString(QLatin1String("Union Station"));
+    QTest::newRow("latin-1") << QByteArray("Caf&eacute; &frac12; &Uuml;ber&nbsp;Stop")
+			     << QString::fromUtf8("Caf\xc3\xa9 \xc2\xbd \xc3\x9c" "ber\xc2\xa0Stop");
+    QTest::newRow("punctuation") << QByteArray("16th &ndash; &ldquo;Mall&rdquo; &mdash; &lt;1&gt;")
+				 << QString::fromUtf8("16th \xe2\x80\x93 \xe2\x80\x9cMall\xe2\x80\x9d \xe2\x80\x94 <1>");
+    QTest::newRow("numeric") << QByteArray("&#68;&#x55;&#X53; &#233;") << QString::fromUtf8("DUS \xc3\xa9");
+    QTest::newRow("apos") << QByteArray("Sam&apos;s") << QString(QLatin1String("Sam's"));
+    QTest::newRow("unknown") << QByteArray("&bogus; &Eacute &amp") << QString::fromUtf8("&bogus; &Eacute &amp");
+}
+
+void RtdScheduleParserTest::entities()
+{
+    QFETCH(QByteArray, html);
+    QFETCH(QString, text);
+
+    RtdSchedulePage page = RtdScheduleParser::parse(schedulePage(html), QLatin1String("15"));
+    QCOMPARE(int(page.status), int(RtdSchedulePage::Found));
+    QCOMPARE(page.schedule.stations.size(), 3);
+    QVERIFY(page.schedule.stations.contains(QLatin1String("Colfax & Broadway")));
+    QVERIFY(page.schedule.stations.contains(text));
+}
+
+// however the page is cut up, it comes out the same
+void RtdScheduleParserTest::streamed()
+{
+    QByteArray html = schedulePage("Caf&eacute; &ndash; Union Station");
+    RtdSchedulePage whole = RtdScheduleParser::parse(html, QLatin1String("15"));
+    QCOMPARE(int(whole.status), int(RtdSchedulePage::Found));
+
+    for (int chunk = 1; chunk <= 64; chunk *= 2) {
+	RtdSchedulePage page = parseStreamed(html, chunk);
+	QCOMPARE(int(page.status), int(whole.status));
+	QCOMPARE(page.direction, whole.direction);
+	QCOMPARE(page.schedule.stations, whole.schedule.stations);
+	QCOMPARE(page.schedule.minutes, whole.schedule.minutes);
+    }
+}
+
+void RtdScheduleParserTest::status_data()
+{
+    QTest::addColumn<QByteArray>("html");
+    QTest::addColumn<int>("status");
+
+    QByteArray page = schedulePage("Colfax &amp; York");
+    QByteArray noHeadline = page;
+    noHeadline.replace("Schedule effective as of", "Schedule for");
+
+    QTest::newRow("schedule") << page << int(RtdSchedulePage::Found);
+    QTest::newRow("cut off") << page.left(page.indexOf("</table>\n</body>")) << int(RtdSchedulePage::Unreadable);
+    QTest::newRow("no headline") << noHeadline << int(RtdSchedulePage::Unreadable);
+    QTest::newRow("no service") << QByteArray("<html><body><p class=\"bodyBlueHeadline\">Route Schedules\n"
+					      "<p class=\"bodyText\">There is no service on this route for the day you selected.\n"
+					      "</body></html>\n") << int(RtdSchedulePage::NotFound);
+    QTest::newRow("no schedule") << QByteArray("<html><body><p class=\"bodyText\">Please choose another day.\n"
+					       "</body></html>\n") << int(RtdSchedulePage::NotFound);
+}
+
+void RtdScheduleParserTest::status()
+{
+    QFETCH(QByteArray, html);
+    QFETCH(int, status);
+
+    QCOMPARE(int(RtdScheduleParser::parse(html, QLatin1String("15")).status), status);
+}
+
+QTEST_KDEMAIN_CORE(RtdScheduleParserTest)
+
+#include "rtdscheduleparsertest.moc"
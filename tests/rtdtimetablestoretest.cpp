@@ -0,0 +1,179 @@
+/*
+ *   Copyright 2009 Benjamin K. Stuhl <bks24@cornell.edu>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2 or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+// The timetable store is mapped straight from disk and queried in place, so
+// a file that has been cut short or scribbled on must be turned away when it
+// is opened rather than sending a lookup off the end of the mapping.
+
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtTest/QtTest>
+
+#include <qtest_kde.h>
+
+#include "../rtdinterntable.h"
+#include "../rtdtimetablestore.h"
+
+static const int DAY = 0;
+static const int DIRECTION = 'E';
+
+class RtdTimetableStoreTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+	void initTestCase();
+	void cleanupTestCase();
+
+	void roundTrip();
+	void truncated();
+	void corrupted();
+
+    private:
+	void writeFile(const QByteArray& image) const;
+	void checkRoute(const RtdTimetableStore& store, const RtdInternTable& names) const;
+
+	QByteArray m_image;
+	QString m_storePath;
+};
+
+void RtdTimetableStoreTest::initTestCase()
+{
+    // two stations, and buses on two subroutes
+    RtdSchedule schedule;
+    schedule.stations << QLatin1String("Colfax & Broadway") << QLatin1String("Colfax & Colorado");
+    schedule.subroutes << QLatin1String("15") << QLatin1String("15L");
+    int minutes[] = { 300, 330, 360, 1450, 310, 340, 1460 };
+    int subroutes[] = { 0, 1, 0, 0, 0, 1, 0 };
+    for (int i = 0; i < 7; i++) {
+	schedule.minutes.append(minutes[i]);
+	schedule.subrouteIndexes.append(subroutes[i]);
+    }
+    schedule.stopStarts << 4 << 7;
+
+    m_storePath = QDir::tempPath() + QLatin1String("/rtdtimetablestoretest.dat");
+    QFile::remove(m_storePath);
+
+    RtdInternTable names;
+    RtdTimetableStore store(m_storePath, &names);
+    store.setValidAsOf(QDate(2009, 8, 23));
+    store.insert(QLatin1String("15"), DAY, DIRECTION, schedule);
+    int epoch, generation;
+    m_image = store.serialize(&epoch, &generation);
+}
+
+void RtdTimetableStoreTest::cleanupTestCase()
+{
+    QFile::remove(m_storePath);
+}
+
+void RtdTimetableStoreTest::writeFile(const QByteArray& image) const
+{
+    QVERIFY(RtdTimetableStore::write(m_storePath, image));
+}
+
+// everything a lookup can reach in @p store has to make sense
+void RtdTimetableStoreTest::checkRoute(const RtdTimetableStore& store, const RtdInternTable& names) const
+{
+    RtdTimetableStore::Route route = store.route(QLatin1String("15"), DAY, DIRECTION);
+    if (!route.isValid())
+	return;
+
+    QVector<quint32> subroutes = route.subroutes();
+    foreach (quint32 subroute, subroutes)
+	QVERIFY(subroute < quint32(names.count()));
+
+    for (int stop = 0; stop < route.stopCount(); stop++) {
+	QVERIFY(route.station(stop) < quint32(names.count()));
+
+	// read every departure, so that a range off the end of the file shows up
+	const quint16 *minutes = route.minutes(stop);
+	const quint16 *subrouteIndexes = route.subrouteIndexes(stop);
+	int previous = 0;
+	for (int i = 0; i < route.departureCount(stop); i++) {
+	    previous = qMax(previous, int(minutes[i]));
+	    QVERIFY(subrouteIndexes[i] < subroutes.size());
+	}
+	QVERIFY(previous <= 0xffff);
+    }
+}
+
+void RtdTimetableStoreTest::roundTrip()
+{
+    writeFile(m_image);
+
+    RtdInternTable names;
+    RtdTimetableStore store(m_storePath, &names);
+    QCOMPARE(store.validAsOf(), QDate(2009, 8, 23));
+
+    RtdTimetableStore::Route route = store.route(QLatin1String("15"), DAY, DIRECTION);
+    QVERIFY(route.isValid());
+    QCOMPARE(route.stopCount(), 2);
+    QCOMPARE(route.subroutes().size(), 2);
+
+    int stop = route.findStation(names.find(QLatin1String("Colfax & Colorado")));
+    QVERIFY(stop >= 0);
+    QCOMPARE(route.departureCount(stop), 3);
+    QCOMPARE(int(route.minutes(stop)[2]), 1460);
+    QCOMPARE(names.string(route.subroutes()[route.subrouteIndexes(stop)[1]]), QString(QLatin1String("15L")));
+}
+
+void RtdTimetableStoreTest::truncated()
+{
+    for (int size = 0; size < m_image.size(); size += 2) {
+	writeFile(m_image.left(size));
+
+	RtdInternTable names;
+	RtdTimetableStore store(m_storePath, &names);
+	QVERIFY(!store.validAsOf().isValid());
+	QVERIFY(!store.route(QLatin1String("15"), DAY, DIRECTION).isValid());
+    }
+}
+
+// overwrite each word of the file in turn: the store must either refuse the
+// file or only hand out lookups that stay inside it
+void RtdTimetableStoreTest::corrupted()
+{
+    const quint32 values[] = { 0xffffffff, 0x10000, 7 };
+    int rejected = 0;
+
+    for (int offset = 0; offset + 4 <= m_image.size(); offset += 4) {
+	for (int v = 0; v < 3; v++) {
+	    QByteArray image = m_image;
+	    memcpy(image.data() + offset, &values[v], sizeof(quint32));
+	    writeFile(image);
+
+	    RtdInternTable names;
+	    RtdTimetableStore store(m_storePath, &names);
+	    if (!store.validAsOf().isValid()) {
+		rejected++;
+		continue;
+	    }
+	    checkRoute(store, names);
+	}
+    }
+
+    // the offsets and ids alone make up most of the file
+    QVERIFY(rejected > 0);
+}
+
+QTEST_KDEMAIN_CORE(RtdTimetableStoreTest)
+
+#include "rtdtimetablestoretest.moc"